@@ -0,0 +1,71 @@
+// Buddhabrot throughput: orbits/s for 1, 2, 4, ... threads up to the number of cores, with and without
+// importance sampling.
+//
+//     make bench && ./out/buddhabrot_bench
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <thread>
+#include <vector>
+
+#include <Buddhabrot.hpp>
+
+using namespace mygl;
+
+static constexpr int BENCH_ROUNDS = 4;
+static constexpr uint64_t BENCH_ORBITS_PER_THREAD = 1 << 18;
+
+static BuddhabrotStats bench(int threads, bool importance_sampling)
+{
+    View view;
+    view.size = ivec2(800, 800);
+    view.scale = dvec2(200.0, 200.0);
+    view.offset = dvec2(-2.0, -2.0);
+    view.max_iterations = 2000;
+
+    BuddhabrotSettings settings;
+    settings.importance_sampling = importance_sampling;
+
+    Buddhabrot buddhabrot(view, settings, threads);
+
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        buddhabrot.run(BENCH_ORBITS_PER_THREAD);
+    }
+
+    return buddhabrot.stats();
+}
+
+int main()
+{
+    int max_threads = int(std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<int> thread_counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    for (bool importance : { false, true }) {
+        printf("%s sampling\n", importance ? "importance" : "uniform");
+
+        double single = 0.0;
+
+        for (int threads : thread_counts) {
+            BuddhabrotStats stats = bench(threads, importance);
+
+            if (threads == 1) {
+                single = stats.orbits_per_second();
+            }
+
+            double speedup = single > 0.0 ? stats.orbits_per_second() / single : 0.0;
+
+            printf("%3d threads: %8.3f M orbits/s  %8.3f M drawn/s  speedup %5.2fx  efficiency %3.0f%%\n", threads,
+                stats.orbits_per_second() / 1e6, double(stats.drawn) / stats.seconds / 1e6, speedup,
+                100.0 * speedup / threads);
+        }
+    }
+
+    return 0;
+}
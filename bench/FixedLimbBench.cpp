@@ -0,0 +1,181 @@
+// Microbenchmark: FixedLimb<N> against a baseline with heap allocated limbs and a runtime
+// precision, the way a value type wrapped around MPFR/GMP behaves (every temporary allocates).
+//
+//     make bench && ./out/fixed_limb_bench
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <chrono>
+#include <vector>
+
+#include <FixedLimb.hpp>
+#include <Kernel.hpp>
+
+using namespace mygl;
+
+// same number format and algorithms as FixedLimb, but the limb count is only known at runtime
+class DynamicLimb {
+
+public:
+    static constexpr int integer_bits = FixedLimb<1>::integer_bits;
+
+    DynamicLimb(size_t limbs, double value) : m_limbs(limbs)
+    {
+        bool negative = value < 0.0;
+        double x = std::ldexp(std::fabs(value), 64 - integer_bits);
+
+        for (size_t i = limbs; i-- > 0;) {
+            double limb = std::floor(x);
+            m_limbs[i] = uint64_t(limb);
+            x = std::ldexp(x - limb, 64);
+        }
+
+        if (negative) {
+            *this = -*this;
+        }
+    }
+
+    DynamicLimb() : DynamicLimb(s_limbs, 0.0) {}
+
+    explicit DynamicLimb(int value) : DynamicLimb(s_limbs, double(value)) {}
+
+    explicit DynamicLimb(double value) : DynamicLimb(s_limbs, value) {}
+
+    bool negative() const { return int64_t(m_limbs.back()) < 0; }
+
+    friend DynamicLimb operator+(const DynamicLimb& a, const DynamicLimb& b)
+    {
+        DynamicLimb res(a.m_limbs.size(), 0.0);
+        uint64_t carry = 0;
+
+        for (size_t i = 0; i < a.m_limbs.size(); i++) {
+            uint64_t sum = a.m_limbs[i] + carry;
+            carry = sum < carry;
+            res.m_limbs[i] = sum + b.m_limbs[i];
+            carry += res.m_limbs[i] < sum;
+        }
+
+        return res;
+    }
+
+    friend DynamicLimb operator-(const DynamicLimb& a) { return DynamicLimb(a.m_limbs.size(), 0.0) - a; }
+
+    friend DynamicLimb operator-(const DynamicLimb& a, const DynamicLimb& b)
+    {
+        DynamicLimb res(a.m_limbs.size(), 0.0);
+        uint64_t borrow = 0;
+
+        for (size_t i = 0; i < a.m_limbs.size(); i++) {
+            uint64_t diff = a.m_limbs[i] - borrow;
+            borrow = a.m_limbs[i] < borrow;
+            res.m_limbs[i] = diff - b.m_limbs[i];
+            borrow += diff < b.m_limbs[i];
+        }
+
+        return res;
+    }
+
+    friend DynamicLimb operator*(const DynamicLimb& a, const DynamicLimb& b)
+    {
+        size_t n = a.m_limbs.size();
+        DynamicLimb ua = a.negative() ? -a : a;
+        DynamicLimb ub = b.negative() ? -b : b;
+
+        std::vector<uint64_t> p(2 * n, 0);
+
+        for (size_t i = 0; i < n; i++) {
+            uint64_t carry = 0;
+
+            for (size_t j = 0; j < n; j++) {
+                p[i + j] = mul_add_64(ua.m_limbs[i], ub.m_limbs[j], p[i + j], carry, carry);
+            }
+
+            p[i + n] = carry;
+        }
+
+        DynamicLimb res(n, 0.0);
+        for (size_t i = 0; i < n; i++) {
+            res.m_limbs[i] = (p[n - 1 + i] >> (64 - integer_bits)) | (p[n + i] << integer_bits);
+        }
+
+        return a.negative() != b.negative() ? -res : res;
+    }
+
+    friend bool operator<=(const DynamicLimb& a, const DynamicLimb& b)
+    {
+        size_t n = a.m_limbs.size();
+
+        if (a.m_limbs[n - 1] != b.m_limbs[n - 1]) {
+            return int64_t(a.m_limbs[n - 1]) < int64_t(b.m_limbs[n - 1]);
+        }
+
+        for (size_t i = n - 1; i-- > 0;) {
+            if (a.m_limbs[i] != b.m_limbs[i]) {
+                return a.m_limbs[i] < b.m_limbs[i];
+            }
+        }
+
+        return true;
+    }
+
+    static size_t s_limbs;
+
+private:
+    std::vector<uint64_t> m_limbs;
+};
+
+size_t DynamicLimb::s_limbs = 1;
+
+// a point on the boundary of the main cardioid, never escapes within the budget
+static constexpr double BENCH_RE = -0.75;
+static constexpr double BENCH_IM = 0.0;
+static constexpr int BENCH_ITERATIONS = 200000;
+
+// volatile in- and output pin the orbit between the two clock reads,
+// otherwise the compiler may fold it or move it out of the timed region
+static volatile double s_bench_re = BENCH_RE;
+static volatile double s_bench_im = BENCH_IM;
+static volatile int s_bench_result = 0;
+
+template<typename T> double ns_per_iteration(int& result)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    Complex<T> c { T(s_bench_re), T(s_bench_im) };
+    s_bench_result = escape_time<Mandelbrot, false, T>(c, Complex<T> { T(0), T(0) }, BENCH_ITERATIONS);
+
+    auto end = std::chrono::steady_clock::now();
+    result = s_bench_result;
+    return std::chrono::duration<double, std::nano>(end - start).count() / BENCH_ITERATIONS;
+}
+
+template<size_t N> void bench_limbs()
+{
+    int fixed_it, dynamic_it;
+
+    double fixed = ns_per_iteration<FixedLimb<N>>(fixed_it);
+
+    DynamicLimb::s_limbs = N;
+    double dynamic = ns_per_iteration<DynamicLimb>(dynamic_it);
+
+    printf("%2zu limbs (%4d bits): FixedLimb %8.2f ns/it   DynamicLimb %8.2f ns/it   speedup %5.1fx%s\n", N,
+        FixedLimb<N>::fraction_bits, fixed, dynamic, dynamic / fixed, fixed_it == dynamic_it ? "" : "  MISMATCH");
+}
+
+int main()
+{
+    int it;
+    printf("double            : %8.2f ns/it\n", ns_per_iteration<double>(it));
+    printf("long double       : %8.2f ns/it\n", ns_per_iteration<long double>(it));
+
+    bench_limbs<1>();
+    bench_limbs<2>();
+    bench_limbs<3>();
+    bench_limbs<4>();
+    bench_limbs<6>();
+    bench_limbs<8>();
+
+    return 0;
+}
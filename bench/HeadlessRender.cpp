@@ -0,0 +1,219 @@
+// Renders the glsl kernels without a window (HeadlessContext, Framebuffer, ReadbackBuffer) and reports how many
+// frames per second make it back to the cpu. Works on gpu nodes as well as with llvmpipe on machines without one.
+//
+//     make headless && ./out/headless_render [--shader 1..3] [--formula 0..3] [--precision float|double]
+//                                            [--size <w>x<h>] [--frames <n>] [--max-it <n>] [--out <file.ppm>]
+//
+// Run it from the repository root, the shaders are loaded from res/.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <MyGL.hpp>
+#include <HeadlessContext.hpp>
+#include <Formula.hpp>
+#include <Kernel.hpp>
+
+using namespace mygl;
+
+// frames in flight between rendering and reading back
+constexpr size_t READBACK_SLOTS = 3;
+
+// each frame zooms in a little, so the driver can't get away with repeating the last one
+constexpr double ZOOM_PER_FRAME = 1.01;
+
+struct Options {
+    int shader { 1 };
+    FormulaType formula { FormulaType::Mandelbrot };
+    Precision precision { Precision::Double };
+    ivec2 size { 1280, 960 };
+    int frames { 100 };
+    int max_iterations { 1000 };
+    std::string out;
+};
+
+static bool parse_options(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        const char* value = argv[i + 1];
+
+        if (option == "--shader") {
+            options.shader = atoi(value);
+        } else if (option == "--formula") {
+            options.formula = FormulaType(atoi(value) % int(FormulaType::Count));
+        } else if (option == "--precision") {
+            options.precision = strcmp(value, "float") == 0 ? Precision::Float : Precision::Double;
+        } else if (option == "--size") {
+            if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+                return false;
+            }
+        } else if (option == "--frames") {
+            options.frames = atoi(value);
+        } else if (option == "--max-it") {
+            options.max_iterations = atoi(value);
+        } else if (option == "--out") {
+            options.out = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    return options.size.x > 0 && options.size.y > 0 && options.frames > 0;
+}
+
+// binary ppm, the rows of the readback are bottom up
+static bool write_ppm(const std::string& path, const uint8_t* rgba, ivec2 size)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+
+    if (!file) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", size.x, size.y);
+
+    std::vector<uint8_t> row(size_t(size.x) * 3);
+
+    for (int y = size.y - 1; y >= 0; y--) {
+        const uint8_t* src = rgba + size_t(y) * size_t(size.x) * 4;
+
+        for (int x = 0; x < size.x; x++) {
+            row[size_t(x) * 3 + 0] = src[x * 4 + 0];
+            row[size_t(x) * 3 + 1] = src[x * 4 + 1];
+            row[size_t(x) * 3 + 2] = src[x * 4 + 2];
+        }
+
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    if (!parse_options(argc, argv, options)) {
+        return -1;
+    }
+
+    HeadlessContext context;
+
+    if (!context.init()) {
+        return -1;
+    }
+
+    printf("renderer: %s\n", context.renderer());
+
+    float vertices[] {
+        -1.0f, 1.0f, //
+        1.0f, 1.0f,  //
+        1.0f, -1.0f, //
+
+        -1.0f, 1.0f,  //
+        -1.0f, -1.0f, //
+        1.0f, -1.0f,  //
+    };
+
+    VertexBuffer quad_buffer(vertices, sizeof(vertices));
+
+    VertexLayout layout;
+    layout.push<float>(2);
+
+    VertexArray quad_array;
+    quad_array.add_buffer(quad_buffer, layout);
+    quad_array.bind();
+
+    ShaderBuilder builder;
+    std::string folder_path = "res/shader" + std::to_string(options.shader);
+    builder.add_shader(GL_VERTEX_SHADER, folder_path + "/vertex.glsl");
+    builder.add_shader(
+        GL_FRAGMENT_SHADER, folder_path + "/fragment.glsl", glsl_kernel(options.formula, false, options.precision));
+    builder.compile_and_link();
+    Shader shader = builder.finish();
+
+    Framebuffer framebuffer;
+
+    if (!framebuffer.allocate(options.size)) {
+        fprintf(stderr, "Framebuffer of %dx%d is incomplete\n", options.size.x, options.size.y);
+        return -1;
+    }
+
+    ReadbackBuffer readback;
+    readback.allocate(size_t(options.size.x) * size_t(options.size.y) * 4, READBACK_SLOTS);
+
+    // same view as the app starts with, the origin in the center
+    dvec2 scale { 200.0, 200.0 };
+    dvec2 center { 0.0, 0.0 };
+
+    framebuffer.bind();
+    shader.bind();
+    shader.set_uniform("u_max_it", options.max_iterations);
+    shader.set_uniform("u_julia_c", dvec2(0.0, 0.0));
+
+    std::vector<size_t> in_flight;
+    std::vector<uint8_t> last_frame;
+    uint64_t checksum = 0;
+
+    auto consume = [&](size_t slot) {
+        auto pixels = static_cast<const uint8_t*>(readback.map_slot(slot));
+
+        // touch every pixel like a real consumer would
+        for (size_t i = 0; i < readback.slot_size(); i += 4) {
+            checksum += pixels[i] + pixels[i + 1] + pixels[i + 2];
+        }
+
+        if (!options.out.empty()) {
+            last_frame.assign(pixels, pixels + readback.slot_size());
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int frame = 0; frame < options.frames; frame++) {
+        shader.set_uniform("u_one_over_scale", 1.0 / scale);
+        shader.set_uniform("u_offset", center - dvec2(options.size) * 0.5 / scale);
+
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // the oldest frame has to be read before its slot is reused
+        if (in_flight.size() == READBACK_SLOTS) {
+            consume(in_flight.front());
+            in_flight.erase(in_flight.begin());
+        }
+
+        in_flight.push_back(readback.read(options.size, GL_RGBA, GL_UNSIGNED_BYTE));
+
+        scale *= ZOOM_PER_FRAME;
+    }
+
+    for (size_t slot : in_flight) {
+        consume(slot);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = double(readback.slot_size()) * options.frames / (1024.0 * 1024.0);
+
+    printf("%s %s %s %dx%d: %d frames in %.2f s, %.2f ms/frame, %.1f fps, readback %.1f MB/s (checksum %llu)\n",
+        folder_path.c_str(), formula_name(options.formula), precision_name(options.precision), options.size.x,
+        options.size.y, options.frames, seconds, 1000.0 * seconds / options.frames, options.frames / seconds,
+        megabytes / seconds, (unsigned long long)checksum);
+
+    if (!options.out.empty() && !write_ppm(options.out, last_frame.data(), options.size)) {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,222 @@
+// Zoom video through an exponential map (ExpMap.hpp) against rendering every frame directly.
+//
+//     make bench && ./out/zoom_video [--size <w>x<h>] [--frames <n>] [--depth <zoom factor>] [--max-it <n>]
+//                                    [--center <x>,<y>] [--check <every nth frame>] [--out <directory>]
+//
+// Only every --check th frame is rendered directly, the cost of the direct video is extrapolated from those.
+// They are compared with the resampled frames as well. --out writes all frames as grayscale ppm files.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <ExpMap.hpp>
+#include <Precision.hpp>
+
+using namespace mygl;
+
+struct Options {
+    ivec2 size { 1280, 960 };
+    int frames { 600 };
+    double depth { 1e4 };
+    int max_iterations { 1000 };
+
+    // seahorse valley
+    dvec2 center { -0.743643887037151, 0.131825904205330 };
+
+    int check { 20 };
+    std::string out;
+};
+
+static bool parse_options(int argc, char** argv, Options& options)
+{
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        const char* value = argv[i + 1];
+
+        if (option == "--size") {
+            if (sscanf(value, "%dx%d", &options.size.x, &options.size.y) != 2) {
+                return false;
+            }
+        } else if (option == "--frames") {
+            options.frames = atoi(value);
+        } else if (option == "--depth") {
+            options.depth = atof(value);
+        } else if (option == "--max-it") {
+            options.max_iterations = atoi(value);
+        } else if (option == "--center") {
+            if (sscanf(value, "%lf,%lf", &options.center.x, &options.center.y) != 2) {
+                return false;
+            }
+        } else if (option == "--check") {
+            options.check = atoi(value);
+        } else if (option == "--out") {
+            options.out = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    return options.size.x > 0 && options.size.y > 0 && options.frames > 0 && options.depth > 1.0
+        && options.check > 0;
+}
+
+static uint64_t sum_iterations(const int* pixels, size_t count)
+{
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        sum += uint64_t(pixels[i]);
+    }
+
+    return sum;
+}
+
+// binary ppm, log of the iteration count in gray and the interior black
+static bool write_ppm(const std::string& path, const int* pixels, ivec2 size, int max_iterations)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+
+    if (!file) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", size.x, size.y);
+
+    std::vector<uint8_t> row(size_t(size.x) * 3);
+    double log_max = std::log(double(max_iterations));
+
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x++) {
+            int n = pixels[size_t(y) * size_t(size.x) + size_t(x)];
+            uint8_t gray = n >= max_iterations ? 0 : uint8_t(255.0 * std::log(double(n + 1)) / log_max);
+
+            row[size_t(x) * 3 + 0] = gray;
+            row[size_t(x) * 3 + 1] = gray;
+            row[size_t(x) * 3 + 2] = gray;
+        }
+
+        fwrite(row.data(), 1, row.size(), file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    if (!parse_options(argc, argv, options)) {
+        return -1;
+    }
+
+    ZoomPath path;
+    path.center = options.center;
+    path.deep_center = { DeepReal(options.center.x), DeepReal(options.center.y) };
+    path.start_radius = 2.0;
+    path.end_radius = path.start_radius / options.depth;
+    path.frames = options.frames;
+
+    View view;
+    view.size = options.size;
+    view.max_iterations = options.max_iterations;
+
+    ExpMap exp_map(view, path);
+
+    // the deepest frame decides the precision
+    View last = exp_map.frame_view(options.frames - 1);
+    view.precision = PrecisionDispatcher().select(last.offset, last.scale, last.size);
+    exp_map = ExpMap(view, path);
+
+    auto seconds_since = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    exp_map.render();
+    double strip_seconds = seconds_since(start);
+
+    uint64_t strip_iterations = sum_iterations(exp_map.strip().data(), exp_map.strip().size());
+
+    printf("%dx%d, %d frames, zoom %g, %s: strip %dx%d (%.1f M samples) in %.2f s\n", options.size.x,
+        options.size.y, options.frames, options.depth, precision_name(view.precision), exp_map.strip_size().x,
+        exp_map.strip_size().y, exp_map.strip_samples() / 1e6, strip_seconds);
+
+    size_t frame_pixels = size_t(options.size.x) * size_t(options.size.y);
+    std::vector<int> frame(frame_pixels);
+    std::vector<int> direct(frame_pixels);
+
+    double resample_seconds = 0.0;
+    double direct_seconds = 0.0;
+    uint64_t direct_iterations = 0;
+    uint64_t patch_iterations = 0;
+    uint64_t compared = 0;
+    uint64_t mismatched = 0;
+    double difference = 0.0;
+    int checked = 0;
+
+    for (int i = 0; i < options.frames; i++) {
+        start = std::chrono::steady_clock::now();
+        exp_map.render_frame(i, frame.data());
+        resample_seconds += seconds_since(start);
+
+        // the patch is the only part of a resampled frame that costs iterations
+        int x0 = std::max(0, options.size.x / 2 - EXPMAP_CENTER_PATCH);
+        int y0 = std::max(0, options.size.y / 2 - EXPMAP_CENTER_PATCH);
+
+        for (int y = y0; y < std::min(options.size.y, y0 + 2 * EXPMAP_CENTER_PATCH); y++) {
+            patch_iterations += sum_iterations(
+                frame.data() + size_t(y) * size_t(options.size.x) + size_t(x0), size_t(2 * EXPMAP_CENTER_PATCH));
+        }
+
+        if (i % options.check == 0) {
+            start = std::chrono::steady_clock::now();
+            render_view(exp_map.frame_view(i), direct.data());
+            direct_seconds += seconds_since(start);
+            direct_iterations += sum_iterations(direct.data(), frame_pixels);
+            checked++;
+
+            for (size_t p = 0; p < frame_pixels; p++) {
+                int delta = std::abs(frame[p] - direct[p]);
+                mismatched += delta != 0;
+                difference += delta;
+            }
+
+            compared += frame_pixels;
+        }
+
+        if (!options.out.empty()) {
+            char name[32];
+            snprintf(name, sizeof(name), "/frame_%05d.ppm", i);
+
+            if (!write_ppm(options.out + name, frame.data(), options.size, options.max_iterations)) {
+                return -1;
+            }
+        }
+    }
+
+    double extrapolate = double(options.frames) / checked;
+    double direct_total_seconds = direct_seconds * extrapolate;
+    double direct_total_iterations = direct_iterations * extrapolate;
+    double map_seconds = strip_seconds + resample_seconds;
+    double map_iterations = double(strip_iterations + patch_iterations);
+
+    printf("exponential map: %.2f s (%.2f ms/frame resampling), %.2f G iterations\n", map_seconds,
+        1000.0 * resample_seconds / options.frames, map_iterations / 1e9);
+    printf("direct (from %d frames): %.2f s, %.2f G iterations\n", checked, direct_total_seconds,
+        direct_total_iterations / 1e9);
+    printf("%.1fx less time, %.1fx fewer iterations; %.1f%% of the pixels differ, by %.1f iterations on average\n",
+        direct_total_seconds / map_seconds, direct_total_iterations / map_iterations, 100.0 * mismatched / compared,
+        difference / compared);
+
+    return 0;
+}
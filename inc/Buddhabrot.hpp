@@ -0,0 +1,585 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <filesystem>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#include <Formula.hpp>
+#include <Kernel.hpp>
+
+namespace mygl {
+
+// Buddhabrot / orbit density: instead of coloring c by its escape time, every point z_1 .. z_n of the orbits
+// that escape is counted in a histogram over the view. The image only converges after billions of orbits.
+
+// orbits iterated side by side. The lanes keep re and im in separate arrays and the step selects with integer
+// masks instead of branching, so clang turns the lane loop into packed vector code. A lane that is done is
+// refilled with the next sample right away.
+constexpr int BUDDHABROT_LANES = 8;
+
+// steps between two checks for finished lanes
+constexpr int BUDDHABROT_LANE_STEPS = 8;
+
+// c is sampled from [-2, 2]^2, everything outside escapes at once
+constexpr double BUDDHABROT_RADIUS = 2.0;
+
+// cells per side of the importance map over the sampling square
+constexpr int IMPORTANCE_GRID = 256;
+
+// share of the samples still drawn uniformly, so no region is starved
+constexpr double IMPORTANCE_UNIFORM = 0.1;
+
+// samples per thread and round, between rounds the histograms are merged and checkpointed
+constexpr uint64_t BUDDHABROT_ROUND_ORBITS = 1 << 18;
+
+// cancellation is polled after this many samples
+constexpr uint64_t BUDDHABROT_CHUNK_ORBITS = 1 << 12;
+
+// xorshift64*, one per thread
+class Xorshift64 {
+
+public:
+    explicit Xorshift64(uint64_t seed = 1) : m_state(seed ? seed : 0x9e3779b97f4a7c15ull) {}
+
+    uint64_t next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 0x2545f4914f6cdd1dull;
+    }
+
+    // [0, 1)
+    double uniform() { return double(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    uint64_t m_state;
+};
+
+struct BuddhabrotSettings {
+    // shorter orbits are not drawn, they only add the blurry halo around the set
+    int min_iterations { 20 };
+
+    // after the first round c is drawn mostly from the cells whose orbits escaped slowly
+    bool importance_sampling { true };
+
+    // the histogram is written to checkpoint_path every checkpoint_interval seconds, empty to disable
+    std::string checkpoint_path;
+    double checkpoint_interval { 30.0 };
+};
+
+struct BuddhabrotStats {
+    int threads { 0 };
+
+    // sampled values of c, including the ones rejected without iterating
+    uint64_t orbits { 0 };
+
+    // orbits that escaped after at least min_iterations and were added to the histogram
+    uint64_t drawn { 0 };
+
+    // orbits sampled by this process, orbits also counts the ones of a loaded checkpoint
+    uint64_t session_orbits { 0 };
+
+    // time spent in run() by this process
+    double seconds { 0.0 };
+
+    double orbits_per_second() const { return seconds > 0.0 ? double(session_orbits) / seconds : 0.0; }
+};
+
+// Accumulates the orbit density of the view (offset, scale, size, max_iterations and formula, julia is ignored).
+//
+// Every worker owns its histogram, rng and counters, so the sampling loop runs without any shared writes.
+// The float histograms of the workers are flushed into a double one after every round: a float bin stops
+// growing once it reaches 2^24, which a long render would otherwise hit in its brightest pixels.
+class Buddhabrot {
+
+public:
+    explicit Buddhabrot(const View& view, BuddhabrotSettings settings = {}, int num_threads = 0) :
+        m_view(view),
+        m_settings(settings),
+        m_pixels(size_t(std::max(0, view.size.x)) * size_t(std::max(0, view.size.y)))
+    {
+        if (num_threads <= 0) {
+            num_threads = int(std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+        m_workers.resize(size_t(num_threads));
+
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            m_workers[i].histogram.assign(m_pixels, 0.0f);
+            m_workers[i].rng = Xorshift64(0x853c49e6748fea9bull * (i + 1));
+        }
+
+        m_histogram.assign(m_pixels, 0.0);
+        m_stats.threads = num_threads;
+    }
+
+    // true if view would accumulate into the same histogram
+    bool matches(const View& view) const
+    {
+        return view.offset == m_view.offset && view.scale == m_view.scale && view.size == m_view.size
+            && view.max_iterations == m_view.max_iterations && view.formula == m_view.formula;
+    }
+
+    // Samples orbits_per_thread orbits on every thread. Returns false if it was cancelled, whatever was
+    // sampled until then is kept.
+    bool run(uint64_t orbits_per_thread = BUDDHABROT_ROUND_ORBITS, const CancelFn& cancelled = {})
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<bool> complete { true };
+
+        bool pilot = m_settings.importance_sampling && m_cell_weight.empty();
+
+        visit_formula(m_view.formula, false, [&](auto formula, auto) {
+            using Formula = decltype(formula);
+
+            std::vector<std::thread> threads;
+            threads.reserve(m_workers.size());
+
+            for (auto& worker : m_workers) {
+                threads.emplace_back([&]() {
+                    if (pilot) {
+                        worker.cell_iterations.assign(size_t(IMPORTANCE_GRID) * IMPORTANCE_GRID, 0.0);
+                    }
+
+                    for (uint64_t done = 0; done < orbits_per_thread; done += BUDDHABROT_CHUNK_ORBITS) {
+                        if (cancelled && cancelled()) {
+                            complete = false;
+                            break;
+                        }
+
+                        sample<Formula>(worker, std::min(BUDDHABROT_CHUNK_ORBITS, orbits_per_thread - done), pilot);
+                    }
+                });
+            }
+
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        });
+
+        if (pilot && complete) {
+            build_importance_map();
+        }
+
+        flush();
+
+        m_stats.session_orbits = 0;
+        m_stats.drawn = m_loaded_drawn;
+
+        for (const auto& worker : m_workers) {
+            m_stats.session_orbits += worker.orbits;
+            m_stats.drawn += worker.drawn;
+        }
+
+        m_stats.orbits = m_loaded_orbits + m_stats.session_orbits;
+
+        m_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (!m_settings.checkpoint_path.empty()) {
+            double since = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_last_checkpoint).count();
+
+            if (since >= m_settings.checkpoint_interval) {
+                save_checkpoint(m_settings.checkpoint_path);
+            }
+        }
+
+        return complete;
+    }
+
+    // the summed histogram, weighted counts per pixel
+    const std::vector<double>& histogram() const { return m_histogram; }
+
+    // writes the histogram scaled to [0, 1] into out
+    void density(float* out) const
+    {
+        double scale = m_max_count > 0.0 ? 1.0 / m_max_count : 0.0;
+
+        for (size_t i = 0; i < m_pixels; i++) {
+            out[i] = float(m_histogram[i] * scale);
+        }
+    }
+
+    // The file holds the parameters of the view and the summed histogram (native byte order),
+    // it is written next to path first and then renamed, so a crash never leaves half a checkpoint.
+    bool save_checkpoint(const std::string& path)
+    {
+        m_last_checkpoint = std::chrono::steady_clock::now();
+
+        std::string temp_path = path + ".tmp";
+        FILE* file = fopen(temp_path.c_str(), "wb");
+
+        if (!file) {
+            fprintf(stderr, "Cannot write checkpoint %s\n", temp_path.c_str());
+            return false;
+        }
+
+        CheckpointHeader header = checkpoint_header();
+        header.orbits = m_stats.orbits;
+        header.drawn = m_stats.drawn;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(m_histogram.data(), sizeof(double), m_histogram.size(), file) == m_histogram.size();
+        ok = fclose(file) == 0 && ok;
+
+        // replaces the old checkpoint atomically, it is never removed first
+        std::error_code error;
+
+        if (ok) {
+            std::filesystem::rename(temp_path, path, error);
+        }
+
+        if (!ok || error) {
+            fprintf(stderr, "Cannot write checkpoint %s\n", path.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    // continues from a checkpoint of the same view, returns false if there is none or it doesn't match
+    bool load_checkpoint(const std::string& path)
+    {
+        FILE* file = fopen(path.c_str(), "rb");
+
+        if (!file) {
+            return false;
+        }
+
+        CheckpointHeader expected = checkpoint_header();
+        CheckpointHeader header;
+        std::vector<double> hist(m_pixels);
+
+        bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, expected.magic, 4) == 0
+            && header.version == expected.version && header.width == expected.width
+            && header.height == expected.height && header.max_iterations == expected.max_iterations
+            && header.min_iterations == expected.min_iterations && header.formula == expected.formula
+            && header.offset_x == expected.offset_x && header.offset_y == expected.offset_y
+            && header.scale_x == expected.scale_x && header.scale_y == expected.scale_y
+            && fread(hist.data(), sizeof(double), hist.size(), file) == hist.size();
+
+        fclose(file);
+
+        if (!ok) {
+            return false;
+        }
+
+        m_histogram = std::move(hist);
+        m_max_count = 0.0;
+
+        for (double count : m_histogram) {
+            m_max_count = std::max(m_max_count, count);
+        }
+        m_loaded_orbits = header.orbits;
+        m_loaded_drawn = header.drawn;
+        m_stats.orbits = m_loaded_orbits;
+        m_stats.drawn = m_loaded_drawn;
+        return true;
+    }
+
+    const BuddhabrotStats& stats() const { return m_stats; }
+
+    const View& view() const { return m_view; }
+
+private:
+    struct Worker {
+        std::vector<float> histogram;
+        std::vector<double> cell_iterations;
+        Xorshift64 rng;
+        uint64_t orbits { 0 };
+        uint64_t drawn { 0 };
+    };
+
+    struct CheckpointHeader {
+        char magic[4];
+        uint32_t version;
+        int32_t width, height;
+        int32_t max_iterations, min_iterations;
+        int32_t formula;
+        int32_t reserved;
+        double offset_x, offset_y;
+        double scale_x, scale_y;
+        uint64_t orbits, drawn;
+    };
+
+    CheckpointHeader checkpoint_header() const
+    {
+        CheckpointHeader header {};
+        memcpy(header.magic, "MGBB", 4);
+        header.version = 1;
+        header.width = m_view.size.x;
+        header.height = m_view.size.y;
+        header.max_iterations = m_view.max_iterations;
+        header.min_iterations = m_settings.min_iterations;
+        header.formula = int32_t(m_view.formula);
+        header.offset_x = m_view.offset.x;
+        header.offset_y = m_view.offset.y;
+        header.scale_x = m_view.scale.x;
+        header.scale_y = m_view.scale.y;
+        return header;
+    }
+
+    // z starts at 0 for every lane, a lane is done once it escaped or ran out of iterations
+    template<typename Formula> void sample(Worker& worker, uint64_t count, bool pilot)
+    {
+        constexpr int L = BUDDHABROT_LANES;
+        const double bailout = 4.0;
+        const int max_it = m_view.max_iterations;
+
+        double zr[L], zi[L], cr[L], ci[L];
+        float weight[L];
+        int n[L];
+        int live[L];
+
+        uint64_t started = 0;
+        int live_lanes = 0;
+
+        auto refill = [&](int l) {
+            Complex<double> c { 0.0, 0.0 };
+            live[l] = started < count && next_sample<Formula>(worker, c, weight[l], count - started, started);
+
+            zr[l] = 0.0;
+            zi[l] = 0.0;
+            cr[l] = c.re;
+            ci[l] = c.im;
+            n[l] = live[l] ? 0 : max_it;
+            live_lanes += live[l];
+        };
+
+        for (int l = 0; l < L; l++) {
+            refill(l);
+        }
+
+        while (live_lanes > 0) {
+            for (int s = 0; s < BUDDHABROT_LANE_STEPS; s++) {
+                for (int l = 0; l < L; l++) {
+                    int inside = int(zr[l] * zr[l] + zi[l] * zi[l] <= bailout) & int(n[l] < max_it);
+                    Complex<double> next
+                        = Formula::step(Complex<double> { zr[l], zi[l] }, Complex<double> { cr[l], ci[l] });
+
+                    zr[l] = inside ? next.re : zr[l];
+                    zi[l] = inside ? next.im : zi[l];
+                    n[l] += inside;
+                }
+            }
+
+            for (int l = 0; l < L; l++) {
+                if (!live[l] || (zr[l] * zr[l] + zi[l] * zi[l] <= bailout && n[l] < max_it)) {
+                    continue;
+                }
+
+                Complex<double> c { cr[l], ci[l] };
+
+                if (n[l] < max_it && n[l] >= m_settings.min_iterations) {
+                    splat<Formula>(worker, c, n[l], weight[l]);
+
+                    if (pilot) {
+                        worker.cell_iterations[cell_of(c)] += double(n[l]);
+                    }
+                }
+
+                live_lanes--;
+                refill(l);
+            }
+        }
+    }
+
+    // draws the next c, samples that are known to stay bounded are counted but skipped.
+    // Returns false if the budget ran out while skipping.
+    template<typename Formula>
+    bool next_sample(Worker& worker, Complex<double>& c, float& weight, uint64_t budget, uint64_t& started)
+    {
+        for (uint64_t i = 0; i < budget; i++) {
+            started++;
+            worker.orbits++;
+
+            size_t cell;
+
+            if (m_cell_weight.empty() || worker.rng.uniform() < IMPORTANCE_UNIFORM) {
+                cell = size_t(worker.rng.next() % (uint64_t(IMPORTANCE_GRID) * IMPORTANCE_GRID));
+            } else {
+                double u = worker.rng.uniform() * m_cdf.back();
+                cell = size_t(std::upper_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin());
+                cell = std::min(cell, m_cdf.size() - 1);
+            }
+
+            const double cell_size = 2.0 * BUDDHABROT_RADIUS / IMPORTANCE_GRID;
+            c.re = (double(cell % IMPORTANCE_GRID) + worker.rng.uniform()) * cell_size - BUDDHABROT_RADIUS;
+            c.im = (double(cell / IMPORTANCE_GRID) + worker.rng.uniform()) * cell_size - BUDDHABROT_RADIUS;
+            weight = m_cell_weight.empty() ? 1.0f : m_cell_weight[cell];
+
+            if constexpr (std::is_same_v<Formula, Mandelbrot>) {
+                if (in_main_bulbs(c)) {
+                    continue;
+                }
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // the main cardioid and the period 2 bulb hold most of the interior, their orbits would run to max_iterations
+    static bool in_main_bulbs(Complex<double> c)
+    {
+        double x = c.re - 0.25;
+        double q = x * x + c.im * c.im;
+
+        if (q * (q + x) <= 0.25 * c.im * c.im) {
+            return true;
+        }
+
+        return (c.re + 1.0) * (c.re + 1.0) + c.im * c.im <= 1.0 / 16.0;
+    }
+
+    // iterates the orbit once more and counts its points, the histogram access is a scatter so this stays scalar
+    template<typename Formula> void splat(Worker& worker, Complex<double> c, int n, float weight)
+    {
+        Complex<double> z { 0.0, 0.0 };
+
+        for (int i = 0; i < n; i++) {
+            z = Formula::step(z, c);
+
+            double x = (z.re - m_view.offset.x) * m_view.scale.x;
+            double y = (z.im - m_view.offset.y) * m_view.scale.y;
+
+            if (x >= 0.0 && y >= 0.0 && x < double(m_view.size.x) && y < double(m_view.size.y)) {
+                worker.histogram[size_t(y) * size_t(m_view.size.x) + size_t(x)] += weight;
+            }
+        }
+
+        worker.drawn++;
+    }
+
+    static size_t cell_of(Complex<double> c)
+    {
+        const double cells_per_unit = IMPORTANCE_GRID / (2.0 * BUDDHABROT_RADIUS);
+        int x = std::clamp(int((c.re + BUDDHABROT_RADIUS) * cells_per_unit), 0, IMPORTANCE_GRID - 1);
+        int y = std::clamp(int((c.im + BUDDHABROT_RADIUS) * cells_per_unit), 0, IMPORTANCE_GRID - 1);
+        return size_t(y) * IMPORTANCE_GRID + size_t(x);
+    }
+
+    // Cells are drawn with probability p = u / cells + (1 - u) * iterations / total iterations, where
+    // iterations are those of the slowly escaping orbits in the pilot round. Samples are weighted by
+    // (1 / cells) / p, so the histogram converges to the same image as uniform sampling.
+    void build_importance_map()
+    {
+        const size_t num_cells = size_t(IMPORTANCE_GRID) * IMPORTANCE_GRID;
+        std::vector<double> cell_iterations(num_cells, 0.0);
+
+        for (const auto& worker : m_workers) {
+            for (size_t i = 0; i < num_cells; i++) {
+                cell_iterations[i] += worker.cell_iterations[i];
+            }
+        }
+
+        double total = 0.0;
+        for (double it : cell_iterations) {
+            total += it;
+        }
+
+        if (total <= 0.0) {
+            return;
+        }
+
+        m_cdf.resize(num_cells);
+        m_cell_weight.resize(num_cells);
+
+        // the cdf only covers the importance part, the uniform share is drawn separately
+        double sum = 0.0;
+
+        for (size_t i = 0; i < num_cells; i++) {
+            sum += cell_iterations[i];
+            m_cdf[i] = sum;
+
+            double p = IMPORTANCE_UNIFORM / double(num_cells) + (1.0 - IMPORTANCE_UNIFORM) * cell_iterations[i] / total;
+            m_cell_weight[i] = float(1.0 / (double(num_cells) * p));
+        }
+    }
+
+    // adds the worker histograms to the double one and clears them, every thread takes a range of pixels
+    void flush()
+    {
+        size_t num_threads = m_workers.size();
+        size_t range = (m_pixels + num_threads - 1) / num_threads;
+        std::vector<double> range_max(num_threads, 0.0);
+        std::vector<std::thread> threads;
+
+        for (size_t t = 0; t < num_threads; t++) {
+            threads.emplace_back([&, t]() {
+                size_t begin = std::min(m_pixels, t * range);
+                size_t end = std::min(m_pixels, begin + range);
+
+                for (auto& worker : m_workers) {
+                    for (size_t i = begin; i < end; i++) {
+                        m_histogram[i] += double(worker.histogram[i]);
+                    }
+
+                    std::fill(worker.histogram.begin() + begin, worker.histogram.begin() + end, 0.0f);
+                }
+
+                for (size_t i = begin; i < end; i++) {
+                    range_max[t] = std::max(range_max[t], m_histogram[i]);
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        m_max_count = *std::max_element(range_max.begin(), range_max.end());
+    }
+
+private:
+    View m_view;
+    BuddhabrotSettings m_settings;
+    size_t m_pixels;
+
+    std::vector<Worker> m_workers;
+
+    // importance sampling, empty until the pilot round is done
+    std::vector<double> m_cdf;
+    std::vector<float> m_cell_weight;
+
+    // everything sampled so far, a loaded checkpoint included
+    std::vector<double> m_histogram;
+    double m_max_count { 0.0 };
+
+    // counters of a loaded checkpoint
+    uint64_t m_loaded_orbits { 0 };
+    uint64_t m_loaded_drawn { 0 };
+
+    std::chrono::steady_clock::time_point m_last_checkpoint { std::chrono::steady_clock::now() };
+    BuddhabrotStats m_stats;
+};
+
+// glsl prelude for the orbit density shading (res/buddhabrot): `float density(ivec2 pixel)` returns the
+// histogram scaled to [0, 1], stored as float bits in the iteration texture.
+inline std::string glsl_texture_density()
+{
+    std::string out;
+
+    out += "uniform isampler2D u_iterations;\n";
+    out += "\n";
+    out += "float density(ivec2 pixel)\n{\n";
+    out += "    return intBitsToFloat(texelFetch(u_iterations, pixel, 0).r);\n";
+    out += "}\n";
+
+    return out;
+}
+
+}
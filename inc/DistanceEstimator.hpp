@@ -0,0 +1,348 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include <Formula.hpp>
+#include <Kernel.hpp>
+#include <RenderStats.hpp>
+
+namespace mygl {
+
+// Exterior distance estimation: besides z the kernel tracks dz/dc (dz/dz0 in Julia mode)
+// and turns it into a lower bound for the distance to the set,
+//     d >= |z| ln|z| / (2 |dz|)     (Koebe 1/4 theorem)
+// The renderer uses it to skip whole blocks of pixels that are known to be outside.
+
+// the estimate needs a bailout radius well above 2 to be accurate,
+// FixedLimb has room for the norm of |z|^4 at this radius
+constexpr double DE_BAILOUT_RADIUS = 8.0;
+
+// blocks are handed to the worker threads in tiles of this size
+constexpr int DE_TILE_SIZE = 32;
+
+// blocks up to this size that can't be filled are evaluated pixel by pixel instead of split further
+constexpr int DE_DIRECT_BLOCK = 4;
+
+struct EscapeDistance {
+    int iterations;
+
+    // lower bound for the distance to the set in world units, negative for points inside
+    double distance;
+};
+
+template<typename Formula, bool Julia, typename T>
+inline EscapeDistance escape_distance(Complex<T> p, Complex<T> julia_c, int max_iterations)
+{
+    static_assert(
+        holds_escape_norm<Formula, T>(DE_BAILOUT_RADIUS), "the number type overflows before the bailout test");
+
+    Complex<T> z, c;
+
+    // dz grows far beyond what fixed point can hold and doesn't need the precision
+    Complex<double> dz;
+
+    if constexpr (Julia) {
+        z = p;
+        c = julia_c;
+        dz = { 1.0, 0.0 };
+    } else {
+        z = Complex<T> { T(0), T(0) };
+        c = p;
+        dz = { 0.0, 0.0 };
+    }
+
+    const T bailout = T(DE_BAILOUT_RADIUS * DE_BAILOUT_RADIUS);
+
+    int n = 0;
+    while (n < max_iterations && norm(z) <= bailout) {
+        dz = Formula::derivative(Complex<double> { double(z.re), double(z.im) }, dz);
+
+        if constexpr (!Julia) {
+            dz.re += 1.0;
+        }
+
+        z = Formula::step(z, c);
+        n++;
+    }
+
+    if (n == max_iterations) {
+        return { n, -1.0 };
+    }
+
+    double z_abs = std::sqrt(double(norm(z)));
+    double dz_abs = std::sqrt(norm(dz));
+
+    return { n, 0.5 * z_abs * std::log(z_abs) / dz_abs };
+}
+
+// Renders the distance to the set in pixels (negative inside) into out.
+//
+// Each tile is subdivided recursively: the kernel runs once at the center pixel of a block and if the
+// disc of the estimated distance covers the whole block, every pixel in it is outside and gets
+// (distance of the center - its distance to the center), a lower bound again. Only blocks close
+// to the boundary are split further, so far from the set the sampling gets very sparse. A block with
+// an interior center or one of at most DE_DIRECT_BLOCK pixels a side is evaluated pixel by pixel, and no
+// pixel is evaluated twice, so no frame takes more iterations than a brute force render. Every
+// iteration tracks the derivative as well though, the time only drops where blocks get filled.
+//
+// With a cost map every kernel evaluation adds its iterations to the nearest pixel, and the filled pixels
+// get -(iterations a brute force render would have spent on them) - 1, which costs a full render on top.
+template<typename Formula, bool Julia, typename T> class DistanceRenderer {
+
+public:
+    DistanceRenderer(const View& view, float* out, int* cost = nullptr) :
+        m_view(view),
+        m_out(out),
+        m_cost(cost),
+        m_julia_c { T(view.julia_c.x), T(view.julia_c.y) },
+        m_step_x(1.0 / view.scale.x),
+        m_step_y(1.0 / view.scale.y),
+        m_offset(view_offset<T>(view)),
+        m_pixels_per_unit(std::min(view.scale.x, view.scale.y))
+    {
+    }
+
+    void render_tile(int x0, int y0, FrameStats& stats)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t iterations_before = stats.iterations;
+
+        int w = std::min(DE_TILE_SIZE, m_view.size.x - x0);
+        int h = std::min(DE_TILE_SIZE, m_view.size.y - y0);
+
+        if (m_cost) {
+            for (int y = y0; y < y0 + h; y++) {
+                std::fill_n(m_cost + size_t(y) * size_t(m_view.size.x) + size_t(x0), w, 0);
+            }
+        }
+
+        render_block(x0, y0, w, h, stats);
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.tiles.push_back({ x0, y0, w, h, ms, stats.iterations - iterations_before });
+    }
+
+private:
+    // a pixel that was already evaluated for an enclosing block, parent is the one of the block around that
+    struct Sample {
+        int x, y;
+        EscapeDistance result;
+        const Sample* parent;
+    };
+
+    void render_block(int x0, int y0, int w, int h, FrameStats& stats, const Sample* known = nullptr)
+    {
+        if (w <= 0 || h <= 0) {
+            return;
+        }
+
+        // the center is always a pixel so its evaluation is never wasted
+        Sample center { x0 + w / 2, y0 + h / 2, {}, known };
+
+        if (known && known->x == center.x && known->y == center.y) {
+            center = *known;
+        } else {
+            center.result = evaluate_pixel(center.x, center.y, stats);
+        }
+
+        // scaled the same for single pixels and filled blocks, or the shading steps at block edges
+        double distance = center.result.distance * m_pixels_per_unit * Formula::distance_safety;
+
+        int rx = std::max(center.x - x0, x0 + w - 1 - center.x);
+        int ry = std::max(center.y - y0, y0 + h - 1 - center.y);
+        double radius = std::sqrt(double(rx * rx + ry * ry));
+
+        if (center.result.distance >= 0.0 && distance > radius) {
+            for (int y = y0; y < y0 + h; y++) {
+                for (int x = x0; x < x0 + w; x++) {
+                    double dx = x - center.x, dy = y - center.y;
+                    store(x, y, float(distance - std::sqrt(dx * dx + dy * dy)));
+
+                    if (m_cost && (x != center.x || y != center.y)) {
+                        save(x, y, stats);
+                    }
+                }
+            }
+
+            // the center and the centers of enclosing blocks that fall inside were counted when evaluated
+            uint64_t evaluated_inside = 0;
+
+            for (const Sample* sample = &center; sample; sample = sample->parent) {
+                evaluated_inside += sample->x >= x0 && sample->x < x0 + w && sample->y >= y0 && sample->y < y0 + h;
+            }
+
+            stats.add_filled(uint64_t(w) * uint64_t(h) - evaluated_inside);
+            return;
+        }
+
+        // Interior centers give no bound at all and small blocks are not worth splitting, the pixels are
+        // evaluated one by one then. Otherwise an all interior tile would run the kernel at every level.
+        if (center.result.distance < 0.0 || (w <= DE_DIRECT_BLOCK && h <= DE_DIRECT_BLOCK)) {
+            for (int y = y0; y < y0 + h; y++) {
+                for (int x = x0; x < x0 + w; x++) {
+                    if (!is_evaluated(&center, x, y)) {
+                        evaluate_pixel(x, y, stats);
+                    }
+                }
+            }
+
+            return;
+        }
+
+        int w0 = (w + 1) / 2, h0 = (h + 1) / 2;
+        render_block(x0, y0, w0, h0, stats, &center);
+        render_block(x0 + w0, y0, w - w0, h0, stats, &center);
+        render_block(x0, y0 + h0, w0, h - h0, stats, &center);
+        render_block(x0 + w0, y0 + h0, w - w0, h - h0, stats, &center);
+    }
+
+    static bool is_evaluated(const Sample* sample, int x, int y)
+    {
+        for (; sample; sample = sample->parent) {
+            if (sample->x == x && sample->y == y) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // runs the kernel for one pixel and stores its own distance, -1 inside
+    EscapeDistance evaluate_pixel(int x, int y, FrameStats& stats)
+    {
+        EscapeDistance result = evaluate(x, y);
+        stats.add_pixel(result.iterations);
+        spend(x, y, result.iterations);
+
+        double distance = result.distance * m_pixels_per_unit * Formula::distance_safety;
+        store(x, y, result.distance < 0.0 ? -1.0f : float(distance));
+        return result;
+    }
+
+    EscapeDistance evaluate(double x, double y)
+    {
+        Complex<T> p { T(x) * T(m_step_x) + m_offset.re, T(y) * T(m_step_y) + m_offset.im };
+        return escape_distance<Formula, Julia, T>(p, m_julia_c, m_view.max_iterations);
+    }
+
+    void store(int x, int y, float distance) { m_out[size_t(y) * size_t(m_view.size.x) + size_t(x)] = distance; }
+
+    void spend(int x, int y, int iterations)
+    {
+        if (m_cost) {
+            int& cost = m_cost[size_t(y) * size_t(m_view.size.x) + size_t(x)];
+            cost = std::max(cost, 0) + iterations;
+        }
+    }
+
+    // a pixel that already ran the kernel for a bigger block keeps what was spent on it
+    void save(int x, int y, FrameStats& stats)
+    {
+        int& cost = m_cost[size_t(y) * size_t(m_view.size.x) + size_t(x)];
+
+        if (cost == 0) {
+            int saved = evaluate(x, y).iterations;
+            stats.saved_iterations += uint64_t(saved);
+            cost = -saved - 1;
+        }
+    }
+
+private:
+    const View& m_view;
+    float* m_out;
+    int* m_cost;
+
+    Complex<T> m_julia_c;
+    double m_step_x;
+    double m_step_y;
+    Complex<T> m_offset;
+    double m_pixels_per_unit;
+};
+
+// renders the view on all cores, tiles are taken from a shared counter. cost is an optional cost map,
+// see DistanceRenderer. It is read back while it is filled, so it can't be a write only mapping.
+// Returns false if it was cancelled.
+inline bool render_distance(const View& view, float* out, const CancelFn& cancelled = {}, FrameStats* stats = nullptr,
+    int* cost = nullptr)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    int tiles_x = (view.size.x + DE_TILE_SIZE - 1) / DE_TILE_SIZE;
+    int tiles_y = (view.size.y + DE_TILE_SIZE - 1) / DE_TILE_SIZE;
+    int num_tiles = tiles_x * tiles_y;
+
+    std::atomic<int> next_tile { 0 };
+    std::atomic<bool> complete { true };
+    std::vector<FrameStats> worker_stats(num_threads);
+
+    visit_kernel(view, [&](auto formula, auto is_julia, auto precision) {
+        using Formula = decltype(formula);
+        using T = typename decltype(precision)::Type;
+        constexpr bool Julia = decltype(is_julia)::value;
+
+        DistanceRenderer<Formula, Julia, T> renderer(view, out, cost);
+
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads);
+
+        for (int i = 0; i < num_threads; i++) {
+            threads.emplace_back([&, i]() {
+                FrameStats& local = worker_stats[i];
+                local.reset(view, "distance");
+
+                for (int tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+                    if (cancelled && cancelled()) {
+                        complete = false;
+                        break;
+                    }
+
+                    renderer.render_tile((tile % tiles_x) * DE_TILE_SIZE, (tile / tiles_x) * DE_TILE_SIZE, local);
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+
+    if (stats) {
+        stats->reset(view, "distance");
+
+        for (const FrameStats& local : worker_stats) {
+            stats->merge(local);
+        }
+
+        stats->frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    return complete;
+}
+
+// glsl prelude for the distance shading (res/distance): `float distance_estimate(ivec2 pixel)`
+// returns the distance rendered by render_distance(), its float bits are stored in the
+// same integer texture as the iteration counts.
+inline std::string glsl_texture_distance()
+{
+    std::string out;
+
+    out += "uniform isampler2D u_iterations;\n";
+    out += "\n";
+    out += "float distance_estimate(ivec2 pixel)\n{\n";
+    out += "    return intBitsToFloat(texelFetch(u_iterations, pixel, 0).r);\n";
+    out += "}\n";
+
+    return out;
+}
+
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <Formula.hpp>
+#include <Kernel.hpp>
+
+namespace mygl {
+
+// Exponential map rendering of a zoom video.
+//
+// All frames of a zoom towards a fixed center are rings around that center, so the whole path is rendered once
+// in log-polar coordinates: a strip with the angle along x and log(radius) along y. The samples are spaced
+// 2 pi / width in both directions, which makes them square and exactly one pixel apart at the corners of a frame
+// and denser further in. Every e-fold of zoom costs 2 pi * half_diagonal^2 samples once, instead of a full frame
+// for every video frame. A frame is then resampled from the strip, only a small patch around the center where
+// the strip would need infinitely many rows is rendered directly.
+
+constexpr double EXPMAP_TWO_PI = 6.283185307179586;
+
+// strip tiles are tall and narrow: one column is one angle from the center outwards, a tile holds a few of them
+constexpr int EXPMAP_TILE_COLUMNS = 8;
+constexpr int EXPMAP_TILE_ROWS = 1024;
+
+// radius in pixels of the square around the center that is rendered directly for every frame
+constexpr int EXPMAP_CENTER_PATCH = 16;
+
+struct ZoomPath {
+    // the point the video zooms into, deep_center is the exact one for deep views
+    dvec2 center { 0.0, 0.0 };
+    Complex<DeepReal> deep_center { DeepReal(0), DeepReal(0) };
+
+    // world distance from the center to a corner of the first and the last frame
+    double start_radius { 2.0 };
+    double end_radius { 1e-6 };
+
+    int frames { 600 };
+
+    // the zoom speed is constant, the radius shrinks geometrically
+    double radius(int frame) const
+    {
+        double t = frames > 1 ? double(frame) / double(frames - 1) : 0.0;
+        return start_radius * std::pow(end_radius / start_radius, t);
+    }
+};
+
+class ExpMap {
+
+public:
+    // view holds the frame size and everything about the kernel, its offset and scale are not used
+    ExpMap(const View& view, const ZoomPath& path) : m_view(view), m_path(path)
+    {
+        m_half_diagonal = 0.5 * std::sqrt(double(view.size.x) * view.size.x + double(view.size.y) * view.size.y);
+
+        m_width = std::max(1, int(std::ceil(EXPMAP_TWO_PI * m_half_diagonal)));
+        m_step = EXPMAP_TWO_PI / m_width;
+
+        // from the edge of the center patch in the last frame to the corners of the first one
+        double min_radius = EXPMAP_CENTER_PATCH * path.end_radius / m_half_diagonal;
+        m_log_min_radius = std::log(min_radius);
+        m_height = std::max(1, int(std::ceil((std::log(path.start_radius) - m_log_min_radius) / m_step)) + 1);
+
+        m_strip.assign(size_t(m_width) * size_t(m_height), 0);
+
+        // the strip column and log radius of a pixel are the same in every frame
+        m_pixel_polar.resize(size_t(view.size.x) * size_t(view.size.y));
+
+        for (int y = 0; y < view.size.y; y++) {
+            for (int x = 0; x < view.size.x; x++) {
+                double dx = x - 0.5 * view.size.x, dy = y - 0.5 * view.size.y;
+
+                // the patch covers the center later, stay inside the strip until then
+                double rho = std::max(std::sqrt(dx * dx + dy * dy), double(EXPMAP_CENTER_PATCH));
+                int column = int(std::floor(std::atan2(dy, dx) / m_step + m_width)) % m_width;
+
+                m_pixel_polar[size_t(y) * size_t(view.size.x) + size_t(x)] = { column, std::log(rho) / m_step };
+            }
+        }
+    }
+
+    // renders the strip on all cores. Returns false if it was cancelled, the strip is incomplete then.
+    bool render(const CancelFn& cancelled = {})
+    {
+        int num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        int tiles_x = (m_width + EXPMAP_TILE_COLUMNS - 1) / EXPMAP_TILE_COLUMNS;
+        int tiles_y = (m_height + EXPMAP_TILE_ROWS - 1) / EXPMAP_TILE_ROWS;
+        int num_tiles = tiles_x * tiles_y;
+
+        std::atomic<int> next_tile { 0 };
+        std::atomic<bool> complete { true };
+
+        visit_kernel(m_view, [&](auto formula, auto is_julia, auto precision) {
+            using Formula = decltype(formula);
+            using T = typename decltype(precision)::Type;
+            constexpr bool Julia = decltype(is_julia)::value;
+
+            std::vector<std::thread> threads;
+            threads.reserve(num_threads);
+
+            for (int i = 0; i < num_threads; i++) {
+                threads.emplace_back([&]() {
+                    for (int tile = next_tile++; tile < num_tiles; tile = next_tile++) {
+                        if (cancelled && cancelled()) {
+                            complete = false;
+                            break;
+                        }
+
+                        render_strip_tile<Formula, Julia, T>(
+                            (tile % tiles_x) * EXPMAP_TILE_COLUMNS, (tile / tiles_x) * EXPMAP_TILE_ROWS);
+                    }
+                });
+            }
+
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        });
+
+        return complete;
+    }
+
+    // View of one frame of the video, e.g. to render it directly for comparison
+    View frame_view(int frame) const
+    {
+        View view = m_view;
+        double pixels_per_unit = m_half_diagonal / m_path.radius(frame);
+        dvec2 half_size = dvec2(view.size) * 0.5 / pixels_per_unit;
+
+        view.scale = dvec2(pixels_per_unit);
+        view.offset = m_path.center - half_size;
+        view.deep_offset.re = m_path.deep_center.re - DeepReal(half_size.x);
+        view.deep_offset.im = m_path.deep_center.im - DeepReal(half_size.y);
+        return view;
+    }
+
+    // Resamples frame from the strip into out (row major, iteration counts like render_view) and renders the
+    // center patch. Returns false if it was cancelled.
+    bool render_frame(int frame, int* out, const CancelFn& cancelled = {})
+    {
+        const View view = frame_view(frame);
+
+        // turns the log radius of a pixel, in steps, into a strip row at the zoom of this frame
+        const double row_offset = (std::log(1.0 / view.scale.x) - m_log_min_radius) / m_step;
+
+        int num_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::atomic<bool> complete { true };
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < num_threads; i++) {
+            threads.emplace_back([&, i]() {
+                for (int y = i; y < view.size.y; y += num_threads) {
+                    if (cancelled && cancelled()) {
+                        complete = false;
+                        return;
+                    }
+
+                    size_t begin = size_t(y) * size_t(view.size.x);
+                    int* row = out + begin;
+
+                    for (int x = 0; x < view.size.x; x++) {
+                        const PixelPolar& polar = m_pixel_polar[begin + size_t(x)];
+                        int strip_row = std::clamp(int(polar.log_rho + row_offset), 0, m_height - 1);
+
+                        row[x] = m_strip[size_t(strip_row) * size_t(m_width) + size_t(polar.column)];
+                    }
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (!complete) {
+            return false;
+        }
+
+        render_center_patch(view, out);
+        return true;
+    }
+
+    ivec2 strip_size() const { return ivec2(m_width, m_height); }
+
+    const std::vector<int>& strip() const { return m_strip; }
+
+    uint64_t strip_samples() const { return uint64_t(m_width) * uint64_t(m_height); }
+
+    // pixels rendered directly for each frame
+    uint64_t patch_pixels() const { return uint64_t(4 * EXPMAP_CENTER_PATCH * EXPMAP_CENTER_PATCH); }
+
+private:
+    // sample (column, row) is at angle (column + 0.5) * step and log radius log_min_radius + (row + 0.5) * step
+    template<typename Formula, bool Julia, typename T> void render_strip_tile(int column0, int row0)
+    {
+        const Complex<T> julia_c { T(m_view.julia_c.x), T(m_view.julia_c.y) };
+        const Complex<T> center = path_center<T>();
+
+        int columns = std::min(EXPMAP_TILE_COLUMNS, m_width - column0);
+        int rows = std::min(EXPMAP_TILE_ROWS, m_height - row0);
+
+        for (int column = column0; column < column0 + columns; column++) {
+            double angle = (column + 0.5) * m_step;
+            double cos_angle = std::cos(angle), sin_angle = std::sin(angle);
+
+            for (int row = row0; row < row0 + rows; row++) {
+                double r = std::exp(m_log_min_radius + (row + 0.5) * m_step);
+                Complex<T> p { center.re + T(r * cos_angle), center.im + T(r * sin_angle) };
+
+                m_strip[size_t(row) * size_t(m_width) + size_t(column)]
+                    = escape_time<Formula, Julia>(p, julia_c, m_view.max_iterations);
+            }
+        }
+    }
+
+    void render_center_patch(const View& view, int* out)
+    {
+        int x0 = std::max(0, view.size.x / 2 - EXPMAP_CENTER_PATCH);
+        int y0 = std::max(0, view.size.y / 2 - EXPMAP_CENTER_PATCH);
+        int w = std::min(2 * EXPMAP_CENTER_PATCH, view.size.x - x0);
+        int h = std::min(2 * EXPMAP_CENTER_PATCH, view.size.y - y0);
+
+        int* patch = out + size_t(y0) * size_t(view.size.x) + size_t(x0);
+
+        visit_kernel(view, [&](auto formula, auto is_julia, auto precision) {
+            using T = typename decltype(precision)::Type;
+            render_tile<decltype(formula), decltype(is_julia)::value, T>(
+                view, patch, size_t(view.size.x), x0, y0, w, h);
+        });
+    }
+
+    template<typename T> Complex<T> path_center() const
+    {
+        if constexpr (std::is_same_v<T, DeepReal>) {
+            return m_path.deep_center;
+        } else {
+            return { T(m_path.center.x), T(m_path.center.y) };
+        }
+    }
+
+private:
+    View m_view;
+    ZoomPath m_path;
+
+    double m_half_diagonal;
+
+    // strip geometry, step is the spacing of the samples in angle and in log radius
+    int m_width;
+    int m_height;
+    double m_step;
+    double m_log_min_radius;
+
+    std::vector<int> m_strip;
+
+    struct PixelPolar {
+        int column;
+        double log_rho;
+    };
+
+    std::vector<PixelPolar> m_pixel_polar;
+};
+
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cmath>
+
+namespace mygl {
+
+// 64 x 64 -> 128 bit multiply-add: returns the low half of a * b + add1 + add2 and stores the
+// high half in hi. The result can't overflow: (2^64 - 1)^2 + 2 * (2^64 - 1) = 2^128 - 1.
+inline uint64_t mul_add_64(uint64_t a, uint64_t b, uint64_t add1, uint64_t add2, uint64_t& hi)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128)a * b + add1 + add2;
+    hi = uint64_t(p >> 64);
+    return uint64_t(p);
+#else
+    // portable fallback (e.g. msvc on 32 bit), four 32 x 32 bit products
+    uint64_t a_lo = a & 0xffffffff, a_hi = a >> 32;
+    uint64_t b_lo = b & 0xffffffff, b_hi = b >> 32;
+
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi;
+    uint64_t hi_hi = a_hi * b_hi;
+
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffff) + lo_hi;
+    uint64_t lo = (cross << 32) | (lo_lo & 0xffffffff);
+    hi = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+
+    lo += add1;
+    hi += lo < add1;
+    lo += add2;
+    hi += lo < add2;
+    return lo;
+#endif
+}
+
+// Signed fixed point number made of N 64 bit limbs (two's complement, least significant limb first).
+// The top integer_bits bits (sign included) are the integer part, so the range is [-2^31, 2^31)
+// which leaves room for the norm of an escaping orbit even with a large bailout radius,
+// everything else is fraction.
+// There is no heap allocation and N is known at compile time, so all loops below unroll and
+// small N stay in registers.
+template<size_t N> class FixedLimb {
+    static_assert(N >= 1, "FixedLimb needs at least one limb");
+
+public:
+    static constexpr int integer_bits = 32;
+    static constexpr int fraction_bits = 64 * int(N) - integer_bits;
+
+    FixedLimb() = default;
+
+    explicit FixedLimb(int value) : FixedLimb(double(value)) {}
+
+    explicit FixedLimb(double value)
+    {
+        bool negative = value < 0.0;
+
+        // value in units of the top limb, then peel off one limb after the other
+        double x = std::ldexp(std::fabs(value), 64 - integer_bits);
+
+        for (size_t i = N; i-- > 0;) {
+            double limb = std::floor(x);
+            m_limbs[i] = uint64_t(limb);
+            x = std::ldexp(x - limb, 64);
+        }
+
+        if (negative) {
+            *this = -*this;
+        }
+    }
+
+    // converts between limb counts, the lowest limbs are cut off or zero filled
+    template<size_t M> explicit FixedLimb(const FixedLimb<M>& other)
+    {
+        for (size_t i = 0; i < N && i < M; i++) {
+            m_limbs[N - 1 - i] = other.limb(M - 1 - i);
+        }
+    }
+
+    explicit operator double() const
+    {
+        FixedLimb a = negative() ? -*this : *this;
+
+        double x = 0.0;
+        for (size_t i = 0; i < N; i++) {
+            x = std::ldexp(x, -64) + double(a.m_limbs[i]);
+        }
+
+        x = std::ldexp(x, -(64 - integer_bits));
+        return negative() ? -x : x;
+    }
+
+    bool negative() const { return int64_t(m_limbs[N - 1]) < 0; }
+
+    uint64_t limb(size_t i) const { return m_limbs[i]; }
+
+    friend FixedLimb operator+(const FixedLimb& a, const FixedLimb& b)
+    {
+        FixedLimb res;
+        uint64_t carry = 0;
+
+        for (size_t i = 0; i < N; i++) {
+            uint64_t sum = a.m_limbs[i] + carry;
+            carry = sum < carry;
+            res.m_limbs[i] = sum + b.m_limbs[i];
+            carry += res.m_limbs[i] < sum;
+        }
+
+        return res;
+    }
+
+    friend FixedLimb operator-(const FixedLimb& a, const FixedLimb& b)
+    {
+        FixedLimb res;
+        uint64_t borrow = 0;
+
+        for (size_t i = 0; i < N; i++) {
+            uint64_t diff = a.m_limbs[i] - borrow;
+            borrow = a.m_limbs[i] < borrow;
+            res.m_limbs[i] = diff - b.m_limbs[i];
+            borrow += diff < b.m_limbs[i];
+        }
+
+        return res;
+    }
+
+    friend FixedLimb operator-(const FixedLimb& a)
+    {
+        FixedLimb res;
+        uint64_t carry = 1;
+
+        for (size_t i = 0; i < N; i++) {
+            res.m_limbs[i] = ~a.m_limbs[i] + carry;
+            carry = carry && res.m_limbs[i] == 0;
+        }
+
+        return res;
+    }
+
+    friend FixedLimb operator*(const FixedLimb& a, const FixedLimb& b)
+    {
+        FixedLimb ua = a.negative() ? -a : a;
+        FixedLimb ub = b.negative() ? -b : b;
+
+        // schoolbook product of the magnitudes, 2N limbs
+        uint64_t p[2 * N] = {};
+
+        for (size_t i = 0; i < N; i++) {
+            uint64_t carry = 0;
+
+            for (size_t j = 0; j < N; j++) {
+                p[i + j] = mul_add_64(ua.m_limbs[i], ub.m_limbs[j], p[i + j], carry, carry);
+            }
+
+            p[i + N] = carry;
+        }
+
+        FixedLimb res = from_product(p);
+        return a.negative() != b.negative() ? -res : res;
+    }
+
+    // a * a with every cross product computed only once
+    friend FixedLimb sqr(const FixedLimb& a)
+    {
+        FixedLimb ua = a.negative() ? -a : a;
+
+        uint64_t p[2 * N] = {};
+
+        // sum of a_i * a_j for i < j
+        for (size_t i = 0; i < N; i++) {
+            uint64_t carry = 0;
+
+            for (size_t j = i + 1; j < N; j++) {
+                p[i + j] = mul_add_64(ua.m_limbs[i], ua.m_limbs[j], p[i + j], carry, carry);
+            }
+
+            p[i + N] = carry;
+        }
+
+        // doubled
+        uint64_t top = 0;
+        for (size_t i = 0; i < 2 * N; i++) {
+            uint64_t next = p[i] >> 63;
+            p[i] = (p[i] << 1) | top;
+            top = next;
+        }
+
+        // plus the squares on the diagonal
+        uint64_t carry = 0;
+        for (size_t i = 0; i < N; i++) {
+            uint64_t hi;
+            uint64_t lo = mul_add_64(ua.m_limbs[i], ua.m_limbs[i], p[2 * i], carry, hi);
+            p[2 * i] = lo;
+
+            uint64_t sum = p[2 * i + 1] + hi;
+            carry = sum < hi;
+            p[2 * i + 1] = sum;
+        }
+
+        return from_product(p);
+    }
+
+    friend FixedLimb abs(const FixedLimb& a) { return a.negative() ? -a : a; }
+
+    friend bool operator==(const FixedLimb& a, const FixedLimb& b)
+    {
+        for (size_t i = 0; i < N; i++) {
+            if (a.m_limbs[i] != b.m_limbs[i]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    friend bool operator<(const FixedLimb& a, const FixedLimb& b)
+    {
+        if (a.m_limbs[N - 1] != b.m_limbs[N - 1]) {
+            return int64_t(a.m_limbs[N - 1]) < int64_t(b.m_limbs[N - 1]);
+        }
+
+        for (size_t i = N - 1; i-- > 0;) {
+            if (a.m_limbs[i] != b.m_limbs[i]) {
+                return a.m_limbs[i] < b.m_limbs[i];
+            }
+        }
+
+        return false;
+    }
+
+    friend bool operator!=(const FixedLimb& a, const FixedLimb& b) { return !(a == b); }
+    friend bool operator>(const FixedLimb& a, const FixedLimb& b) { return b < a; }
+    friend bool operator<=(const FixedLimb& a, const FixedLimb& b) { return !(b < a); }
+    friend bool operator>=(const FixedLimb& a, const FixedLimb& b) { return !(a < b); }
+
+private:
+    // the product of two numbers has 2 * fraction_bits fraction bits, keep the upper N limbs
+    // above fraction_bits (truncating, values beyond the range wrap around)
+    static FixedLimb from_product(const uint64_t (&p)[2 * N])
+    {
+        FixedLimb res;
+
+        for (size_t i = 0; i < N; i++) {
+            res.m_limbs[i] = (p[N - 1 + i] >> (64 - integer_bits)) | (p[N + i] << integer_bits);
+        }
+
+        return res;
+    }
+
+private:
+    uint64_t m_limbs[N] {};
+};
+
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+#include <Precision.hpp>
+
+namespace mygl {
+
+template<typename T> struct Complex {
+    T re;
+    T im;
+};
+
+template<typename T> inline Complex<T> operator+(Complex<T> a, Complex<T> b) { return { a.re + b.re, a.im + b.im }; }
+
+template<typename T> inline Complex<T> operator-(Complex<T> a, Complex<T> b) { return { a.re - b.re, a.im - b.im }; }
+
+template<typename T> inline Complex<T> operator*(Complex<T> a, Complex<T> b)
+{
+    return { a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re };
+}
+
+// number types with a cheaper square than x * x (FixedLimb) overload this
+template<typename T> inline T sqr(T x) { return x * x; }
+
+template<typename T> inline Complex<T> square(Complex<T> z) { return { sqr(z.re) - sqr(z.im), (z.re + z.re) * z.im }; }
+
+template<typename T> inline T norm(Complex<T> z) { return sqr(z.re) + sqr(z.im); }
+
+// z^D with the multiplication chain unrolled at compile time (square-and-multiply),
+// so z^4 is two squarings and z^5 two squarings and one multiply.
+template<int D, typename T> inline Complex<T> cpow(Complex<T> z)
+{
+    static_assert(D >= 1, "cpow needs a positive exponent");
+
+    if constexpr (D == 1) {
+        return z;
+    } else if constexpr (D % 2 == 0) {
+        return square(cpow<D / 2>(z));
+    } else {
+        return cpow<D - 1>(z) * z;
+    }
+}
+
+// emits the same multiplication chain as cpow<D>() as glsl statements
+// and returns the name of the variable holding the result.
+template<int D> inline std::string glsl_cpow(std::string& out)
+{
+    static_assert(D >= 1, "glsl_cpow needs a positive exponent");
+
+    if constexpr (D == 1) {
+        return "z";
+    } else {
+        std::string name = "p" + std::to_string(D);
+
+        if constexpr (D % 2 == 0) {
+            std::string half = glsl_cpow<D / 2>(out);
+            out += "    cvec " + name + " = csqr(" + half + ");\n";
+        } else {
+            std::string prev = glsl_cpow<D - 1>(out);
+            out += "    cvec " + name + " = cmul(" + prev + ", z);\n";
+        }
+
+        return name;
+    }
+}
+
+// A formula is a stateless type providing
+//  - step(z, c): one iteration of the recurrence for any arithmetic type T
+//  - derivative(z, dz): d(step)/dz * dz, used to track dz/dc for distance estimation
+//  - distance_safety: how far the distance estimate can be trusted (1 where it is a proven bound)
+//  - glsl_step(out): the body of `cvec formula_step(cvec z, cvec c)` in glsl
+// Kernels are templates on the formula so every specialisation compiles to its own loop.
+
+template<int D> struct Multibrot {
+    static constexpr int degree = D;
+    static constexpr double distance_safety = 1.0;
+
+    static const char* name()
+    {
+        switch (D) {
+        case 2:
+            return "mandelbrot";
+        case 3:
+            return "multibrot3";
+        case 4:
+            return "multibrot4";
+        default:
+            return "multibrot";
+        }
+    }
+
+    template<typename T> static Complex<T> step(Complex<T> z, Complex<T> c) { return cpow<D>(z) + c; }
+
+    template<typename T> static Complex<T> derivative(Complex<T> z, Complex<T> dz)
+    {
+        return Complex<T> { T(D), T(0) } * cpow<D - 1>(z) * dz;
+    }
+
+    static void glsl_step(std::string& out)
+    {
+        std::string res = glsl_cpow<D>(out);
+        out += "    return " + res + " + c;\n";
+    }
+};
+
+using Mandelbrot = Multibrot<2>;
+
+struct BurningShip {
+    static constexpr int degree = 2;
+    static constexpr double distance_safety = 0.25;
+
+    static const char* name() { return "burning_ship"; }
+
+    template<typename T> static Complex<T> step(Complex<T> z, Complex<T> c)
+    {
+        using std::abs;
+        return square(Complex<T> { abs(z.re), abs(z.im) }) + c;
+    }
+
+    // the fold isn't holomorphic, mirroring dz the same way as z gives the usual estimate
+    template<typename T> static Complex<T> derivative(Complex<T> z, Complex<T> dz)
+    {
+        using std::abs;
+        Complex<T> folded_dz { z.re < T(0) ? -dz.re : dz.re, z.im < T(0) ? -dz.im : dz.im };
+        return Complex<T> { T(2), T(0) } * Complex<T> { abs(z.re), abs(z.im) } * folded_dz;
+    }
+
+    static void glsl_step(std::string& out) { out += "    return csqr(abs(z)) + c;\n"; }
+};
+
+enum class FormulaType : int {
+    Mandelbrot,
+    Multibrot3,
+    Multibrot4,
+    BurningShip,
+    Count,
+};
+
+// the only runtime branch on the formula: picks the specialisation once per frame
+// and calls fn(Formula {}, std::bool_constant<Julia> {}).
+template<typename Fn> inline decltype(auto) visit_formula(FormulaType type, bool julia, Fn&& fn)
+{
+    auto with_mode = [&](auto formula) -> decltype(auto) {
+        if (julia) {
+            return fn(formula, std::true_type {});
+        } else {
+            return fn(formula, std::false_type {});
+        }
+    };
+
+    switch (type) {
+    case FormulaType::Multibrot3:
+        return with_mode(Multibrot<3> {});
+    case FormulaType::Multibrot4:
+        return with_mode(Multibrot<4> {});
+    case FormulaType::BurningShip:
+        return with_mode(BurningShip {});
+    case FormulaType::Mandelbrot:
+    default:
+        return with_mode(Mandelbrot {});
+    }
+}
+
+inline const char* formula_name(FormulaType type)
+{
+    return visit_formula(type, false, [](auto formula, auto) { return decltype(formula)::name(); });
+}
+
+// Generates the glsl kernel prelude for a formula. It declares the view uniforms and
+// defines `int iterate(ivec2 pixel)` which the fragment shaders in res/ call for coloring.
+// In Julia mode z starts at the pixel and c is the fixed u_julia_c.
+// The pixel position is always computed in double, only the iteration runs in the
+// requested precision (glsl has nothing beyond double, Extended falls back to it).
+template<typename Formula, bool Julia> inline std::string glsl_kernel(Precision precision = Precision::Double)
+{
+    std::string out;
+
+    out += "uniform dvec2 u_one_over_scale;\n";
+    out += "uniform dvec2 u_offset;\n";
+    out += "uniform dvec2 u_julia_c;\n";
+    out += "uniform int u_max_it;\n";
+    out += "\n";
+    out += precision == Precision::Float ? "#define cvec vec2\n" : "#define cvec dvec2\n";
+    out += "cvec csqr(cvec z) { return cvec(z.x * z.x - z.y * z.y, (z.x + z.x) * z.y); }\n";
+    out += "cvec cmul(cvec a, cvec b) { return cvec(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x); }\n";
+    out += "\n";
+    out += "cvec formula_step(cvec z, cvec c)\n{\n";
+    Formula::glsl_step(out);
+    out += "}\n";
+    out += "\n";
+    out += "int iterate(ivec2 pixel)\n{\n";
+    out += "    cvec p = cvec(dvec2(pixel) * u_one_over_scale + u_offset);\n";
+
+    if constexpr (Julia) {
+        out += "    cvec z = p;\n";
+        out += "    cvec c = cvec(u_julia_c);\n";
+    } else {
+        out += "    cvec z = cvec(0.0, 0.0);\n";
+        out += "    cvec c = p;\n";
+    }
+
+    out += "    int n = 0;\n";
+    out += "    while (n < u_max_it && dot(z, z) <= 4.0) {\n";
+    out += "        z = formula_step(z, c);\n";
+    out += "        n++;\n";
+    out += "    }\n";
+    out += "    return n;\n";
+    out += "}\n";
+
+    return out;
+}
+
+inline std::string glsl_kernel(FormulaType type, bool julia, Precision precision = Precision::Double)
+{
+    return visit_formula(type, julia, [&](auto formula, auto is_julia) {
+        return glsl_kernel<decltype(formula), decltype(is_julia)::value>(precision);
+    });
+}
+
+}
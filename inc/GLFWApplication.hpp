@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -12,6 +14,8 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <InputLog.hpp>
+
 namespace mygl {
 
 using namespace glm;
@@ -233,10 +237,19 @@ public:
         return post_init();
     }
 
-    ~GLFWApplication() { glfwTerminate(); }
+    ~GLFWApplication()
+    {
+        end_session();
+        glfwTerminate();
+    }
 
+    // during a replay both return the state of the recorded session, not the live one
     ivec2 window_size()
     {
+        if (m_replaying) {
+            return m_replay_size;
+        }
+
         ivec2 size;
         glfwGetWindowSize(m_window, &size.x, &size.y);
         return size;
@@ -244,11 +257,77 @@ public:
 
     dvec2 mouse_pos()
     {
+        if (m_replaying) {
+            return m_replay_cursor;
+        }
+
         dvec2 mouse;
         glfwGetCursorPos(m_window, &mouse.x, &mouse.y);
         return mouse;
     }
 
+    // writes every input event from now on to path, see InputLogWriter for the format
+    bool record_input(const std::string& path)
+    {
+        InputLogHeader header;
+        header.window_size = window_size();
+        header.cursor = mouse_pos();
+
+        if (!m_input_log.open(path, header)) {
+            return false;
+        }
+
+        start_session();
+        return true;
+    }
+
+    // Feeds a recorded session back into the event handlers, live input is ignored meanwhile.
+    // real_time keeps the recorded timing, otherwise the next event is sent as soon as the frame
+    // of the previous one is on screen. The window closes once the last event is presented.
+    bool replay_input(const std::string& path, bool real_time)
+    {
+        InputLogHeader header;
+
+        if (!read_input_log(path, header, m_replay)) {
+            return false;
+        }
+
+        m_replaying = true;
+        m_replay_real_time = real_time;
+        m_replay_next = 0;
+        m_replay_size = header.window_size;
+        m_replay_cursor = header.cursor;
+
+        glfwSetWindowSize(m_window, header.window_size.x, header.window_size.y);
+
+        start_session();
+        return true;
+    }
+
+    bool replaying() const { return m_replaying; }
+
+    // event to present latency of the current session so far
+    LatencyStats input_latency() const { return m_latency.stats(); }
+
+    // prints the latency of the session and closes the log
+    void end_session()
+    {
+        if (!m_session_active) {
+            return;
+        }
+
+        m_session_active = false;
+
+        LatencyStats stats = m_latency.stats();
+        printf("input latency: %zu events, p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n", stats.count,
+            stats.p50_ms, stats.p95_ms, stats.p99_ms, stats.max_ms);
+
+        if (m_input_log.is_open()) {
+            printf("recorded %zu input events\n", m_input_log.count());
+            m_input_log.close();
+        }
+    }
+
 protected:
     // runs just after glfwInit() and before the window is created
     // usefull to give advanced window hints to glfw.
@@ -271,37 +350,204 @@ protected:
 
     virtual void resize_event(ivec2 size) {}
 
+    // replaces glfwWaitEvents() / glfwWaitEventsTimeout() in run(), a negative timeout waits
+    // indefinitely. While replaying it sends the recorded events that are due instead.
+    void wait_events(double timeout = -1.0)
+    {
+        if (!m_replaying) {
+            if (timeout < 0.0) {
+                glfwWaitEvents();
+            } else {
+                glfwWaitEventsTimeout(timeout);
+            }
+            return;
+        }
+
+        // frame_presented() posts an empty event, so waiting never takes longer than the frame
+        double wait = timeout < 0.0 ? REPLAY_POLL_INTERVAL : std::min(timeout, REPLAY_POLL_INTERVAL);
+
+        if (m_replay_next == m_replay.size()) {
+            if (m_latency.pending() == 0 || session_time_us() - m_replay_wait_start > REPLAY_FRAME_TIMEOUT_US) {
+                m_replaying = false;
+                end_session();
+                glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+            } else {
+                glfwWaitEventsTimeout(wait);
+            }
+            return;
+        }
+
+        uint64_t now = session_time_us();
+
+        if (m_replay_real_time) {
+            uint64_t due = m_replay[m_replay_next].time_us;
+
+            if (due > now) {
+                glfwWaitEventsTimeout(std::min(wait, double(due - now) / 1e6));
+                return;
+            }
+
+            glfwPollEvents();
+
+            while (m_replay_next < m_replay.size() && m_replay[m_replay_next].time_us <= now) {
+                dispatch(m_replay[m_replay_next++]);
+            }
+        } else {
+            // as fast as possible, but one frame at a time so every event is actually measured
+            if (m_latency.pending() > 0 && now - m_replay_wait_start < REPLAY_FRAME_TIMEOUT_US) {
+                glfwWaitEventsTimeout(wait);
+                return;
+            }
+
+            glfwPollEvents();
+            dispatch(m_replay[m_replay_next++]);
+        }
+
+        m_replay_wait_start = session_time_us();
+    }
+
+    // Called by the event handlers when they need a new frame. The returned serial identifies the
+    // event, pass it to frame_presented() once a frame containing it is on screen.
+    uint64_t request_frame()
+    {
+        if (m_dispatching && m_session_active) {
+            m_latency.begin(m_input_serial, m_dispatch_time_us);
+        }
+
+        return m_input_serial;
+    }
+
+    // thread safe, usually called by a render thread right after swapping buffers
+    void frame_presented(uint64_t serial)
+    {
+        if (!m_session_active) {
+            return;
+        }
+
+        m_latency.presented(serial, session_time_us());
+
+        if (m_replaying) {
+            glfwPostEmptyEvent();
+        }
+    }
+
 private:
+    static constexpr double REPLAY_POLL_INTERVAL = 0.01;
+
+    // events in the log that ask for a frame which never shows up must not stall the replay
+    static constexpr uint64_t REPLAY_FRAME_TIMEOUT_US = 2000000;
+
+    void start_session()
+    {
+        m_session_start = std::chrono::steady_clock::now();
+        m_session_active = true;
+        m_replay_wait_start = 0;
+        m_latency.clear();
+    }
+
+    uint64_t session_time_us() const
+    {
+        auto elapsed = std::chrono::steady_clock::now() - m_session_start;
+        return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+    }
+
+    // events from glfw, they are dropped while a replay is running
+    void live_event(InputRecord record)
+    {
+        if (m_replaying) {
+            return;
+        }
+
+        record.time_us = session_time_us();
+        m_input_log.write(record);
+        dispatch(record);
+    }
+
+    void dispatch(const InputRecord& record)
+    {
+        m_input_serial++;
+        m_dispatch_time_us = session_time_us();
+        m_dispatching = true;
+
+        switch (record.type) {
+        case InputType::Key:
+            key_event(KeyEvent { static_cast<Key>(record.code), static_cast<KeyAction>(record.action),
+                static_cast<Modifier>(record.mods) });
+            break;
+        case InputType::Mouse:
+            mouse_event(MouseEvent { static_cast<MouseButton>(record.code), static_cast<MouseAction>(record.action),
+                static_cast<Modifier>(record.mods) });
+            break;
+        case InputType::Scroll:
+            scroll_event(record.pos);
+            break;
+        case InputType::Cursor:
+            m_replay_cursor = record.pos;
+            cursor_event(record.pos);
+            break;
+        case InputType::Resize:
+            m_replay_size = ivec2(record.pos);
+
+            // the real window has to follow, frames are rendered at this size. Its own size callback is
+            // ignored while replaying.
+            if (m_replaying) {
+                glfwSetWindowSize(m_window, m_replay_size.x, m_replay_size.y);
+            }
+
+            resize_event(m_replay_size);
+            break;
+        }
+
+        m_dispatching = false;
+    }
+
     static void glfw_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
     {
         GLFWApplication* this_ptr = static_cast<GLFWApplication*>(glfwGetWindowUserPointer(window));
-        auto event = KeyEvent { static_cast<Key>(key), static_cast<KeyAction>(action), static_cast<Modifier>(mods) };
-        this_ptr->key_event(event);
+        InputRecord record;
+        record.type = InputType::Key;
+        record.code = key;
+        record.action = action;
+        record.mods = mods;
+        this_ptr->live_event(record);
     }
 
     static void glfw_scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
     {
         GLFWApplication* this_ptr = static_cast<GLFWApplication*>(glfwGetWindowUserPointer(window));
-        this_ptr->scroll_event(dvec2 { xoffset, yoffset });
+        InputRecord record;
+        record.type = InputType::Scroll;
+        record.pos = dvec2 { xoffset, yoffset };
+        this_ptr->live_event(record);
     }
 
     static void glfw_cursor_callback(GLFWwindow* window, double xpos, double ypos)
     {
         GLFWApplication* this_ptr = static_cast<GLFWApplication*>(glfwGetWindowUserPointer(window));
-        this_ptr->cursor_event(dvec2 { xpos, ypos });
+        InputRecord record;
+        record.type = InputType::Cursor;
+        record.pos = dvec2 { xpos, ypos };
+        this_ptr->live_event(record);
     }
 
     static void glfw_window_size_callback(GLFWwindow* window, int width, int height)
     {
         GLFWApplication* this_ptr = static_cast<GLFWApplication*>(glfwGetWindowUserPointer(window));
-        this_ptr->resize_event(ivec2 { width, height });
+        InputRecord record;
+        record.type = InputType::Resize;
+        record.pos = dvec2(width, height);
+        this_ptr->live_event(record);
     }
 
     static void glfw_mouse_button_callback(GLFWwindow* window, int button, int action, int mods) 
     {
         GLFWApplication* this_ptr = static_cast<GLFWApplication*>(glfwGetWindowUserPointer(window));
-        MouseEvent event = MouseEvent { static_cast<MouseButton>(button), static_cast<MouseAction>(action), static_cast<Modifier>(mods) };
-        this_ptr->mouse_event(event);
+        InputRecord record;
+        record.type = InputType::Mouse;
+        record.code = button;
+        record.action = action;
+        record.mods = mods;
+        this_ptr->live_event(record);
     }
 
     static void glfw_error_callback(int error, const char* description)
@@ -318,6 +564,27 @@ private:
 protected:
     std::string m_name { "GLFW App" };
     GLFWwindow* m_window { nullptr };
+
+private:
+    // frame_presented() reads these from the render thread. m_session_start is only written before
+    // m_session_active is set.
+    std::chrono::steady_clock::time_point m_session_start;
+    std::atomic<bool> m_session_active { false };
+
+    uint64_t m_input_serial { 0 };
+    uint64_t m_dispatch_time_us { 0 };
+    bool m_dispatching { false };
+    LatencyTracker m_latency;
+
+    InputLogWriter m_input_log;
+
+    std::vector<InputRecord> m_replay;
+    size_t m_replay_next { 0 };
+    std::atomic<bool> m_replaying { false };
+    bool m_replay_real_time { true };
+    uint64_t m_replay_wait_start { 0 };
+    ivec2 m_replay_size { 0, 0 };
+    dvec2 m_replay_cursor { 0.0, 0.0 };
 };
 
 } // namespace mygl
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace mygl {
+
+// OpenGL context without a window or display server, for batch jobs and benchmarks.
+//
+// It uses EGL on Mesa's surfaceless platform, which works with the gpu drivers as well as with llvmpipe on
+// machines without a gpu, and falls back to the default EGL display elsewhere. There is no default framebuffer,
+// render into a Framebuffer (MyGL.hpp). OSMesa is not supported, Mesa has removed it in favour of EGL.
+class HeadlessContext {
+
+public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    ~HeadlessContext() { release(); }
+
+    // creates a core profile context of the highest version from 4.5 down to 4.0 and makes it current
+    bool init()
+    {
+        m_display = open_display();
+
+        if (m_display == EGL_NO_DISPLAY) {
+            fprintf(stderr, "EGL Error: no display\n");
+            return false;
+        }
+
+        EGLint major, minor;
+
+        if (!eglInitialize(m_display, &major, &minor)) {
+            fprintf(stderr, "EGL Error: eglInitialize failed (0x%x)\n", eglGetError());
+            m_display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            fprintf(stderr, "EGL Error: no desktop OpenGL\n");
+            return false;
+        }
+
+        // without EGL_KHR_no_config_context a config is needed even though nothing is drawn to a surface
+        EGLConfig config = EGL_NO_CONFIG_KHR;
+
+        if (!has_extension(eglQueryString(m_display, EGL_EXTENSIONS), "EGL_KHR_no_config_context")) {
+            const EGLint config_attribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+            EGLint num_configs = 0;
+
+            if (!eglChooseConfig(m_display, config_attribs, &config, 1, &num_configs) || num_configs == 0) {
+                fprintf(stderr, "EGL Error: no OpenGL config\n");
+                return false;
+            }
+        }
+
+        for (int version_minor = 5; version_minor >= 0 && m_context == EGL_NO_CONTEXT; version_minor--) {
+            const EGLint context_attribs[] = {
+                EGL_CONTEXT_MAJOR_VERSION, 4,                                         //
+                EGL_CONTEXT_MINOR_VERSION, version_minor,                             //
+                EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, //
+                EGL_NONE,                                                             //
+            };
+
+            m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, context_attribs);
+        }
+
+        if (m_context == EGL_NO_CONTEXT) {
+            fprintf(stderr, "EGL Error: no OpenGL 4.x core context (0x%x)\n", eglGetError());
+            return false;
+        }
+
+        if (!make_current()) {
+            return false;
+        }
+
+        // glewInit() asks the window system (glx) for extensions, there is none here
+        glewExperimental = GL_TRUE;
+
+        if (glewContextInit() != GLEW_OK) {
+            fprintf(stderr, "GLEW Error: cannot load the OpenGL functions\n");
+            return false;
+        }
+
+        return true;
+    }
+
+    // the context can only be current on one thread at a time, like with glfwMakeContextCurrent()
+    bool make_current()
+    {
+        if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+            fprintf(stderr, "EGL Error: eglMakeCurrent failed (0x%x)\n", eglGetError());
+            return false;
+        }
+
+        return true;
+    }
+
+    void release_current() { eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT); }
+
+    // e.g. "llvmpipe (LLVM 15.0.7, 256 bits)"
+    const char* renderer() const { return reinterpret_cast<const char*>(glGetString(GL_RENDERER)); }
+
+private:
+    static EGLDisplay open_display()
+    {
+        const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+        if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+            auto get_platform_display
+                = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+            if (get_platform_display) {
+                EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+
+                if (display != EGL_NO_DISPLAY) {
+                    return display;
+                }
+            }
+        }
+
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    static bool has_extension(const char* extensions, const char* name)
+    {
+        if (!extensions) {
+            return false;
+        }
+
+        size_t length = strlen(name);
+
+        for (const char* p = strstr(extensions, name); p; p = strstr(p + length, name)) {
+            bool starts = p == extensions || p[-1] == ' ';
+            bool ends = p[length] == ' ' || p[length] == '\0';
+
+            if (starts && ends) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void release()
+    {
+        if (m_display == EGL_NO_DISPLAY) {
+            return;
+        }
+
+        release_current();
+
+        if (m_context != EGL_NO_CONTEXT) {
+            eglDestroyContext(m_display, m_context);
+        }
+
+        eglTerminate(m_display);
+
+        m_context = EGL_NO_CONTEXT;
+        m_display = EGL_NO_DISPLAY;
+    }
+
+private:
+    EGLDisplay m_display { EGL_NO_DISPLAY };
+    EGLContext m_context { EGL_NO_CONTEXT };
+};
+
+}
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+namespace mygl {
+
+using namespace glm;
+
+enum class InputType : uint8_t {
+    Key,
+    Mouse,
+    Scroll,
+    Cursor,
+    Resize,
+};
+
+// one input event as GLFWApplication dispatches it
+struct InputRecord {
+    // since the start of the session
+    uint64_t time_us { 0 };
+
+    InputType type { InputType::Key };
+
+    // key or mouse button, action and modifiers
+    int32_t code { 0 };
+    int32_t action { 0 };
+    int32_t mods { 0 };
+
+    // cursor position, scroll offset or window size
+    dvec2 pos { 0.0, 0.0 };
+};
+
+// Binary input log: a header with the window state at the start of the session, followed by the
+// records. Each record is the time since the previous one (u32 microseconds), the type (u8) and
+// only the fields the type uses: key 4 + 1 + 1 bytes, mouse 1 + 1 + 1, scroll and cursor 2 x f64,
+// resize 2 x i32. Values are stored in native byte order.
+constexpr char INPUT_LOG_MAGIC[4] = { 'M', 'G', 'I', 'L' };
+constexpr uint32_t INPUT_LOG_VERSION = 1;
+
+struct InputLogHeader {
+    ivec2 window_size { 0, 0 };
+    dvec2 cursor { 0.0, 0.0 };
+};
+
+class InputLogWriter {
+
+public:
+    InputLogWriter() = default;
+    InputLogWriter(const InputLogWriter&) = delete;
+    InputLogWriter& operator=(const InputLogWriter&) = delete;
+
+    ~InputLogWriter() { close(); }
+
+    bool open(const std::string& path, const InputLogHeader& header)
+    {
+        close();
+
+        m_file = fopen(path.c_str(), "wb");
+
+        if (!m_file) {
+            fprintf(stderr, "Cannot open input log %s for writing\n", path.c_str());
+            return false;
+        }
+
+        fwrite(INPUT_LOG_MAGIC, 1, sizeof(INPUT_LOG_MAGIC), m_file);
+        write<uint32_t>(INPUT_LOG_VERSION);
+        write<int32_t>(header.window_size.x);
+        write<int32_t>(header.window_size.y);
+        write<double>(header.cursor.x);
+        write<double>(header.cursor.y);
+
+        m_last_time_us = 0;
+        m_count = 0;
+        return true;
+    }
+
+    void write(const InputRecord& record)
+    {
+        if (!m_file) {
+            return;
+        }
+
+        uint64_t delta = record.time_us - std::min(record.time_us, m_last_time_us);
+        m_last_time_us = record.time_us;
+
+        write<uint32_t>(uint32_t(std::min<uint64_t>(delta, UINT32_MAX)));
+        write<uint8_t>(uint8_t(record.type));
+
+        switch (record.type) {
+        case InputType::Key:
+            write<int32_t>(record.code);
+            write<uint8_t>(uint8_t(record.action));
+            write<uint8_t>(uint8_t(record.mods));
+            break;
+        case InputType::Mouse:
+            write<uint8_t>(uint8_t(record.code));
+            write<uint8_t>(uint8_t(record.action));
+            write<uint8_t>(uint8_t(record.mods));
+            break;
+        case InputType::Scroll:
+        case InputType::Cursor:
+            write<double>(record.pos.x);
+            write<double>(record.pos.y);
+            break;
+        case InputType::Resize:
+            write<int32_t>(int32_t(record.pos.x));
+            write<int32_t>(int32_t(record.pos.y));
+            break;
+        }
+
+        m_count++;
+    }
+
+    void close()
+    {
+        if (m_file) {
+            fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+
+    bool is_open() const { return m_file != nullptr; }
+
+    size_t count() const { return m_count; }
+
+private:
+    template<typename T> void write(T value) { fwrite(&value, sizeof(T), 1, m_file); }
+
+private:
+    FILE* m_file { nullptr };
+    uint64_t m_last_time_us { 0 };
+    size_t m_count { 0 };
+};
+
+// reads a whole log written by InputLogWriter. Returns false if the file is missing or not a log,
+// a truncated last record is dropped.
+inline bool read_input_log(const std::string& path, InputLogHeader& header, std::vector<InputRecord>& records)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (!file) {
+        fprintf(stderr, "Cannot open input log %s\n", path.c_str());
+        return false;
+    }
+
+    auto read = [file](auto& value) { return fread(&value, sizeof(value), 1, file) == 1; };
+
+    char magic[4];
+    uint32_t version = 0;
+    int32_t width = 0, height = 0;
+    double cursor_x = 0.0, cursor_y = 0.0;
+
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, INPUT_LOG_MAGIC, 4) == 0
+        && read(version) && version == INPUT_LOG_VERSION && read(width) && read(height) && read(cursor_x)
+        && read(cursor_y);
+
+    if (!ok) {
+        fprintf(stderr, "%s is not an input log\n", path.c_str());
+        fclose(file);
+        return false;
+    }
+
+    header.window_size = ivec2(width, height);
+    header.cursor = dvec2(cursor_x, cursor_y);
+    records.clear();
+
+    uint64_t time_us = 0;
+    uint32_t delta;
+    uint8_t type;
+
+    while (read(delta) && read(type)) {
+        InputRecord record;
+        time_us += delta;
+        record.time_us = time_us;
+        record.type = InputType(type);
+
+        uint8_t code8, action8, mods8;
+        int32_t x32, y32;
+
+        switch (record.type) {
+        case InputType::Key:
+            ok = read(record.code) && read(action8) && read(mods8);
+            record.action = action8;
+            record.mods = mods8;
+            break;
+        case InputType::Mouse:
+            ok = read(code8) && read(action8) && read(mods8);
+            record.code = code8;
+            record.action = action8;
+            record.mods = mods8;
+            break;
+        case InputType::Scroll:
+        case InputType::Cursor:
+            ok = read(record.pos.x) && read(record.pos.y);
+            break;
+        case InputType::Resize:
+            ok = read(x32) && read(y32);
+            record.pos = dvec2(x32, y32);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+
+        if (!ok) {
+            break;
+        }
+
+        records.push_back(record);
+    }
+
+    fclose(file);
+    return true;
+}
+
+struct LatencyStats {
+    size_t count { 0 };
+    double p50_ms { 0.0 };
+    double p95_ms { 0.0 };
+    double p99_ms { 0.0 };
+    double max_ms { 0.0 };
+};
+
+// Event to present latency. The ui thread marks the events that asked for a new frame together with
+// their serial, the render thread reports the serial of the newest event a presented frame includes.
+// All marked events up to it are done: a frame that was cancelled in favour of a newer one simply
+// counts towards the next frame that makes it to the screen.
+class LatencyTracker {
+
+public:
+    void begin(uint64_t serial, uint64_t time_us)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_pending.empty() || m_pending.back().serial != serial) {
+            m_pending.push_back({ serial, time_us });
+        }
+    }
+
+    void presented(uint64_t serial, uint64_t time_us)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        while (!m_pending.empty() && m_pending.front().serial <= serial) {
+            m_samples_us.push_back(time_us - std::min(time_us, m_pending.front().time_us));
+            m_pending.pop_front();
+        }
+    }
+
+    // number of events still waiting for their frame
+    size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pending.size();
+    }
+
+    LatencyStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        LatencyStats stats;
+        stats.count = m_samples_us.size();
+
+        if (m_samples_us.empty()) {
+            return stats;
+        }
+
+        std::vector<uint64_t> sorted = m_samples_us;
+        std::sort(sorted.begin(), sorted.end());
+
+        // nearest rank
+        auto percentile = [&sorted](double p) {
+            size_t rank = size_t(std::ceil(p * double(sorted.size())));
+            return double(sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1]) / 1000.0;
+        };
+
+        stats.p50_ms = percentile(0.50);
+        stats.p95_ms = percentile(0.95);
+        stats.p99_ms = percentile(0.99);
+        stats.max_ms = double(sorted.back()) / 1000.0;
+        return stats;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.clear();
+        m_samples_us.clear();
+    }
+
+private:
+    struct Pending {
+        uint64_t serial;
+        uint64_t time_us;
+    };
+
+    mutable std::mutex m_mutex;
+    std::deque<Pending> m_pending;
+    std::vector<uint64_t> m_samples_us;
+};
+
+}
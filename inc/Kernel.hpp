@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <glm/glm.hpp>
+
+#include <Formula.hpp>
+#include <Precision.hpp>
+
+namespace mygl {
+
+using namespace glm;
+
+// everything needed to render one frame, in the same units as MyApp:
+// world = screen / scale + offset, screen y pointing down.
+struct View {
+    dvec2 offset { 0.0, 0.0 };
+    dvec2 scale { 200.0, 200.0 };
+    ivec2 size { 0, 0 };
+
+    int max_iterations { 1000 };
+
+    FormulaType formula { FormulaType::Mandelbrot };
+    bool julia { false };
+    dvec2 julia_c { 0.0, 0.0 };
+
+    // number type the cpu kernel iterates in, see PrecisionDispatcher
+    Precision precision { Precision::Double };
+
+    // offset is rounded to double, deep views need the exact one
+    Complex<DeepReal> deep_offset { DeepReal(0), DeepReal(0) };
+};
+
+template<typename T> inline Complex<T> view_offset(const View& view)
+{
+    if constexpr (std::is_same_v<T, DeepReal>) {
+        return view.deep_offset;
+    } else {
+        return { T(view.offset.x), T(view.offset.y) };
+    }
+}
+
+// Largest norm of z right after the step that takes it past bailout_radius, for |c| <= 2.
+// Fixed point has to hold it, otherwise the bailout test compares an overflowed value.
+template<typename Formula, typename T> constexpr bool holds_escape_norm(double bailout_radius)
+{
+    if constexpr (std::is_same_v<T, DeepReal>) {
+        double z = 1.0;
+        for (int i = 0; i < Formula::degree; i++) {
+            z *= bailout_radius;
+        }
+
+        return (z + 2.0) * (z + 2.0) < double(uint64_t(1) << (DeepReal::integer_bits - 1));
+    } else {
+        return true;
+    }
+}
+
+// escape time of a single point. Formula and Julia are compile time parameters
+// so the loop body contains no branches besides the bailout test.
+template<typename Formula, bool Julia, typename T>
+inline int escape_time(Complex<T> p, Complex<T> julia_c, int max_iterations)
+{
+    static_assert(holds_escape_norm<Formula, T>(2.0), "the number type overflows before the bailout test");
+
+    Complex<T> z, c;
+
+    if constexpr (Julia) {
+        z = p;
+        c = julia_c;
+    } else {
+        z = Complex<T> { T(0), T(0) };
+        c = p;
+    }
+
+    const T bailout = T(4);
+
+    int n = 0;
+    while (n < max_iterations && norm(z) <= bailout) {
+        z = Formula::step(z, c);
+        n++;
+    }
+
+    return n;
+}
+
+// polled by the kernels between rows, a frame is abandoned once it returns true
+using CancelFn = std::function<bool()>;
+
+// renders the rows y_begin, y_begin + y_step, ... < y_end of the view into out (row major, view.size.x wide).
+// Returns false if it was cancelled, the rows rendered so far are left in out.
+template<typename Formula, bool Julia, typename T>
+inline bool render_rows(const View& view, int* out, int y_begin, int y_end, int y_step = 1,
+    const CancelFn& cancelled = {})
+{
+    const Complex<T> julia_c { T(view.julia_c.x), T(view.julia_c.y) };
+    const T step_x = T(1.0 / view.scale.x);
+    const T step_y = T(1.0 / view.scale.y);
+    const Complex<T> offset = view_offset<T>(view);
+
+    for (int y = y_begin; y < y_end; y += y_step) {
+        if (cancelled && cancelled()) {
+            return false;
+        }
+
+        const T im = T(y) * step_y + offset.im;
+        int* row = out + size_t(y) * size_t(view.size.x);
+
+        for (int x = 0; x < view.size.x; x++) {
+            const T re = T(x) * step_x + offset.re;
+            row[x] = escape_time<Formula, Julia>(Complex<T> { re, im }, julia_c, view.max_iterations);
+        }
+    }
+
+    return true;
+}
+
+// renders the w x h pixels at (x0, y0) of the view into out, which is stride pixels wide and starts at the
+// tile's top left corner.
+template<typename Formula, bool Julia, typename T>
+inline void render_tile(const View& view, int* out, size_t stride, int x0, int y0, int w, int h)
+{
+    const Complex<T> julia_c { T(view.julia_c.x), T(view.julia_c.y) };
+    const T step_x = T(1.0 / view.scale.x);
+    const T step_y = T(1.0 / view.scale.y);
+    const Complex<T> offset = view_offset<T>(view);
+
+    for (int y = 0; y < h; y++) {
+        const T im = T(y0 + y) * step_y + offset.im;
+        int* row = out + size_t(y) * stride;
+
+        for (int x = 0; x < w; x++) {
+            const T re = T(x0 + x) * step_x + offset.re;
+            row[x] = escape_time<Formula, Julia>(Complex<T> { re, im }, julia_c, view.max_iterations);
+        }
+    }
+}
+
+// calls fn(Formula {}, std::bool_constant<Julia> {}, PrecisionTrait<P> {}) for the kernel the view
+// asks for. This is where the runtime settings turn into one template specialisation.
+template<typename Fn> inline decltype(auto) visit_kernel(const View& view, Fn&& fn)
+{
+    return visit_formula(view.formula, view.julia, [&](auto formula, auto is_julia) -> decltype(auto) {
+        return visit_precision(
+            view.precision, [&](auto precision) -> decltype(auto) { return fn(formula, is_julia, precision); });
+    });
+}
+
+// renders the whole view on all cores, rows are interleaved between the threads
+// so the expensive parts of the image are shared evenly. Returns false if it was cancelled.
+inline bool render_view(const View& view, int* out, const CancelFn& cancelled = {})
+{
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<bool> complete { true };
+
+    visit_kernel(view, [&](auto formula, auto is_julia, auto precision) {
+        using Formula = decltype(formula);
+        using T = typename decltype(precision)::Type;
+        constexpr bool Julia = decltype(is_julia)::value;
+
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads);
+
+        for (int i = 0; i < num_threads; i++) {
+            threads.emplace_back([&, i]() {
+                if (!render_rows<Formula, Julia, T>(view, out, i, view.size.y, num_threads, cancelled)) {
+                    complete = false;
+                }
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+
+    return complete;
+}
+
+// glsl prelude for displaying a cpu rendered frame: provides the same `int iterate(ivec2 pixel)`
+// as glsl_kernel() but reads the iteration count from the u_iterations texture.
+inline std::string glsl_texture_kernel()
+{
+    std::string out;
+
+    out += "uniform int u_max_it;\n";
+    out += "uniform isampler2D u_iterations;\n";
+    out += "\n";
+    out += "int iterate(ivec2 pixel)\n{\n";
+    out += "    return texelFetch(u_iterations, pixel, 0).r;\n";
+    out += "}\n";
+
+    return out;
+}
+
+}
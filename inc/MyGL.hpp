@@ -229,6 +229,428 @@ private:
     uint32_t m_id { 0 };
 };
 
+// Pixel unpack buffer that stays mapped for its whole lifetime (glBufferStorage with a
+// persistent, coherent mapping), so the cpu writes straight into memory the gpu reads from.
+// The storage is a ring of slots: the cpu fills one slot while the gpu may still be
+// uploading from the others, a fence per slot tells when it can be written again.
+// Without GL 4.4 or ARB_buffer_storage (e.g. macOS) each slot is mapped with glMapBufferRange
+// when it is handed out and unmapped again before the upload.
+class PixelBuffer {
+
+public:
+    // the buffer object is only created by allocate(), like Texture
+    PixelBuffer() = default;
+
+    ~PixelBuffer() { release(); }
+
+    void allocate(size_t slot_size, size_t num_slots = 3)
+    {
+        release();
+
+        m_slot_size = slot_size;
+        m_num_slots = num_slots;
+        m_slot = 0;
+        m_fences.assign(num_slots, nullptr);
+        m_persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+        glGenBuffers(1, &m_id);
+        bind();
+
+        if (m_persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slot_size * num_slots, nullptr, flags);
+            m_mapping
+                = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slot_size * num_slots, flags));
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, slot_size * num_slots, nullptr, GL_STREAM_DRAW);
+        }
+
+        unbind();
+    }
+
+    // waits until the gpu is done reading the current slot and returns its memory.
+    // The mapping is write combined: write it sequentially and never read from it.
+    void* map_slot()
+    {
+        GLsync& fence = m_fences[m_slot];
+
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        if (m_persistent) {
+            return m_mapping + m_slot * m_slot_size;
+        }
+
+        // a cancelled frame may have left the slot mapped
+        if (!m_mapping) {
+            // the fence above already synchronized, the driver doesn't have to
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+
+            bind();
+            m_mapping
+                = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, slot_offset(), m_slot_size, flags));
+            unbind();
+        }
+
+        return m_mapping;
+    }
+
+    // gl can only read the slot once it is unmapped, Texture::set_data() calls this.
+    // Nothing to do with a persistent mapping.
+    void unmap_slot()
+    {
+        if (m_persistent || !m_mapping) {
+            return;
+        }
+
+        bind();
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        unbind();
+        m_mapping = nullptr;
+    }
+
+    // call once the gl commands reading the current slot are issued, moves on to the next slot
+    void fence_slot()
+    {
+        m_fences[m_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_slot = (m_slot + 1) % m_num_slots;
+    }
+
+    // byte offset of the current slot, this is the "pointer" for gl calls while the buffer is bound
+    size_t slot_offset() const { return m_slot * m_slot_size; }
+
+    size_t slot_size() const { return m_slot_size; }
+
+    void bind() const { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_id); }
+
+    void unbind() const { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+
+private:
+    void release()
+    {
+        if (!m_id) {
+            return;
+        }
+
+        for (GLsync fence : m_fences) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
+
+        if (m_mapping) {
+            bind();
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            unbind();
+        }
+
+        glDeleteBuffers(1, &m_id);
+
+        m_id = 0;
+        m_mapping = nullptr;
+        m_slot_size = 0;
+    }
+
+private:
+    uint32_t m_id { 0 };
+
+    // the whole buffer if persistent, otherwise the current slot while it is mapped
+    uint8_t* m_mapping { nullptr };
+    bool m_persistent { false };
+
+    size_t m_slot_size { 0 };
+    size_t m_num_slots { 0 };
+    size_t m_slot { 0 };
+    std::vector<GLsync> m_fences;
+};
+
+class Texture {
+
+public:
+    // the texture object is only created by allocate(),
+    // so a Texture can be constructed before there is a context.
+    Texture() = default;
+
+    ~Texture()
+    {
+        if (m_id) {
+            glDeleteTextures(1, &m_id);
+        }
+    }
+
+    void bind(uint32_t unit = 0) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, m_id);
+    }
+
+    void unbind() const { glBindTexture(GL_TEXTURE_2D, 0); }
+
+    // (re)allocates the storage, contents are undefined afterwards.
+    // integer formats only support GL_NEAREST filtering.
+    void allocate(ivec2 size, GLenum internal_format, GLenum format, GLenum type)
+    {
+        if (!m_id) {
+            glGenTextures(1, &m_id);
+        }
+
+        bind();
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, size.x, size.y, 0, format, type, nullptr);
+
+        m_size = size;
+        m_format = format;
+        m_type = type;
+    }
+
+    void set_data(const void* data)
+    {
+        bind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_size.x, m_size.y, m_format, m_type, data);
+    }
+
+    // uploads the current slot of the buffer. The copy is queued on the gpu,
+    // the cpu neither copies nor waits; fence the slot afterwards.
+    void set_data(PixelBuffer& buffer)
+    {
+        buffer.unmap_slot();
+
+        bind();
+        buffer.bind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_size.x, m_size.y, m_format, m_type,
+            reinterpret_cast<const void*>(buffer.slot_offset()));
+        buffer.unbind();
+    }
+
+    ivec2 size() const { return m_size; }
+
+private:
+    uint32_t m_id { 0 };
+    ivec2 m_size { 0, 0 };
+    GLenum m_format { GL_RED };
+    GLenum m_type { GL_UNSIGNED_BYTE };
+};
+
+// Offscreen render target with an RGBA8 color attachment, used instead of the window
+// where there is none (HeadlessContext). Created lazily by allocate() like Texture.
+class Framebuffer {
+
+public:
+    Framebuffer() = default;
+
+    ~Framebuffer() { release(); }
+
+    // (re)allocates the color buffer, returns false if the driver does not accept the framebuffer
+    bool allocate(ivec2 size)
+    {
+        if (!m_id) {
+            glGenFramebuffers(1, &m_id);
+            glGenRenderbuffers(1, &m_color);
+        }
+
+        glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        bind();
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        m_size = size;
+        return complete;
+    }
+
+    // also sets the viewport to the whole framebuffer
+    void bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_id);
+        glViewport(0, 0, m_size.x, m_size.y);
+    }
+
+    void unbind() const { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+
+    ivec2 size() const { return m_size; }
+
+private:
+    void release()
+    {
+        if (!m_id) {
+            return;
+        }
+
+        glDeleteRenderbuffers(1, &m_color);
+        glDeleteFramebuffers(1, &m_id);
+        m_id = 0;
+        m_color = 0;
+    }
+
+private:
+    uint32_t m_id { 0 };
+    uint32_t m_color { 0 };
+    ivec2 m_size { 0, 0 };
+};
+
+// The download counterpart of PixelBuffer: a ring of slots in one persistently mapped pack buffer.
+// read() only queues the copy from the bound read framebuffer and returns at once, the data is
+// picked up later with map_slot(), so the gpu keeps rendering the next frames in the meantime.
+// Without GL 4.4 or ARB_buffer_storage a slot is mapped for reading once its fence passed and
+// unmapped again before the next read().
+class ReadbackBuffer {
+
+public:
+    ReadbackBuffer() = default;
+
+    ~ReadbackBuffer() { release(); }
+
+    void allocate(size_t slot_size, size_t num_slots = 3)
+    {
+        release();
+
+        m_slot_size = slot_size;
+        m_num_slots = num_slots;
+        m_next = 0;
+        m_fences.assign(num_slots, nullptr);
+        m_persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+
+        glGenBuffers(1, &m_id);
+        bind();
+
+        if (m_persistent) {
+            const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_PACK_BUFFER, slot_size * num_slots, nullptr, flags);
+            m_mapping
+                = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot_size * num_slots, flags));
+        } else {
+            glBufferData(GL_PIXEL_PACK_BUFFER, slot_size * num_slots, nullptr, GL_STREAM_READ);
+        }
+
+        unbind();
+    }
+
+    // queues glReadPixels of the size.x * size.y pixels at the origin into the next slot and returns the
+    // slot. Rows come bottom up, like everything glReadPixels returns. The slot must not be in use anymore,
+    // with num_slots slots up to num_slots reads can be in flight.
+    size_t read(ivec2 size, GLenum format, GLenum type)
+    {
+        size_t slot = m_next;
+        m_next = (m_next + 1) % m_num_slots;
+
+        if (m_fences[slot]) {
+            glDeleteSync(m_fences[slot]);
+        }
+
+        // gl can't write into a buffer that is mapped without GL_MAP_PERSISTENT_BIT
+        unmap_slot();
+
+        bind();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, size.x, size.y, format, type, reinterpret_cast<void*>(slot * m_slot_size));
+        unbind();
+
+        m_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return slot;
+    }
+
+    // waits until the copy into slot is done and returns its memory. Without buffer storage only one slot is
+    // mapped at a time, the memory stays valid until the next read() or map_slot() of another slot.
+    const void* map_slot(size_t slot)
+    {
+        GLsync& fence = m_fences[slot];
+
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        if (m_persistent) {
+            return m_mapping + slot * m_slot_size;
+        }
+
+        if (m_mapping && m_mapped_slot == slot) {
+            return m_mapping;
+        }
+
+        unmap_slot();
+
+        bind();
+        m_mapping = static_cast<const uint8_t*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, slot * m_slot_size, m_slot_size, GL_MAP_READ_BIT));
+        unbind();
+        m_mapped_slot = slot;
+
+        return m_mapping;
+    }
+
+    size_t slot_size() const { return m_slot_size; }
+
+    size_t num_slots() const { return m_num_slots; }
+
+    void bind() const { glBindBuffer(GL_PIXEL_PACK_BUFFER, m_id); }
+
+    void unbind() const { glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); }
+
+private:
+    // nothing to do with a persistent mapping
+    void unmap_slot()
+    {
+        if (m_persistent || !m_mapping) {
+            return;
+        }
+
+        bind();
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        unbind();
+        m_mapping = nullptr;
+    }
+
+    void release()
+    {
+        if (!m_id) {
+            return;
+        }
+
+        for (GLsync fence : m_fences) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
+
+        if (m_mapping) {
+            bind();
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            unbind();
+        }
+
+        glDeleteBuffers(1, &m_id);
+
+        m_id = 0;
+        m_mapping = nullptr;
+        m_slot_size = 0;
+    }
+
+private:
+    uint32_t m_id { 0 };
+
+    // the whole buffer if persistent, otherwise m_mapped_slot while it is mapped
+    const uint8_t* m_mapping { nullptr };
+    size_t m_mapped_slot { 0 };
+    bool m_persistent { false };
+
+    size_t m_slot_size { 0 };
+    size_t m_num_slots { 0 };
+    size_t m_next { 0 };
+    std::vector<GLsync> m_fences;
+};
+
 class Shader {
     friend class ShaderBuilder;
 
@@ -282,7 +704,9 @@ public:
     ShaderBuilder() = default;
     ~ShaderBuilder() = default;
 
-    bool add_shader(uint32_t shader_type, std::string path)
+    // prelude is inserted right after the #version line of the file,
+    // this is how generated code (e.g. the formula kernels) gets into the shaders.
+    bool add_shader(uint32_t shader_type, std::string path, const std::string& prelude = "")
     {
         assert(
             shader_type == GL_VERTEX_SHADER || shader_type == GL_GEOMETRY_SHADER || shader_type == GL_FRAGMENT_SHADER);
@@ -314,11 +738,17 @@ public:
         }
         #endif
 
+        if (!prelude.empty()) {
+            size_t version_end = contents.find('\n');
+            version_end = version_end == std::string::npos ? contents.size() : version_end + 1;
+            contents.insert(version_end, prelude + "#line 2\n");
+        }
+
         uint32_t shader_id = glCreateShader(shader_type);
         m_shader_ids[shader_type] = shader_id;
 
         const char* str = contents.c_str();
-        int size = static_cast<int>(length);
+        int size = static_cast<int>(contents.size());
         glShaderSource(shader_id, 1, &str, &size);
 
         return true;
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <float.h>
+
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <FixedLimb.hpp>
+
+namespace mygl {
+
+using namespace glm;
+
+enum class Precision : int {
+    Float,
+    Double,
+    Extended,
+    Deep,
+    Count,
+};
+
+// number type for views beyond long double, iterates directly in fixed point (~1e-67)
+using DeepReal = FixedLimb<4>;
+
+template<Precision P> struct PrecisionTrait {
+};
+
+template<> struct PrecisionTrait<Precision::Float> {
+    using Type = float;
+    static constexpr int mantissa_bits = FLT_MANT_DIG;
+    static const char* name() { return "float"; }
+};
+
+template<> struct PrecisionTrait<Precision::Double> {
+    using Type = double;
+    static constexpr int mantissa_bits = DBL_MANT_DIG;
+    static const char* name() { return "double"; }
+};
+
+template<> struct PrecisionTrait<Precision::Extended> {
+    using Type = long double;
+    static constexpr int mantissa_bits = LDBL_MANT_DIG;
+    static const char* name() { return "extended"; }
+};
+
+template<> struct PrecisionTrait<Precision::Deep> {
+    using Type = DeepReal;
+    static constexpr int mantissa_bits = DeepReal::fraction_bits;
+    static const char* name() { return "deep"; }
+};
+
+// calls fn(PrecisionTrait<P> {}) for the runtime precision
+template<typename Fn> inline decltype(auto) visit_precision(Precision precision, Fn&& fn)
+{
+    switch (precision) {
+    case Precision::Float:
+        return fn(PrecisionTrait<Precision::Float> {});
+    case Precision::Extended:
+        return fn(PrecisionTrait<Precision::Extended> {});
+    case Precision::Deep:
+        return fn(PrecisionTrait<Precision::Deep> {});
+    case Precision::Double:
+    default:
+        return fn(PrecisionTrait<Precision::Double> {});
+    }
+}
+
+inline int mantissa_bits(Precision precision)
+{
+    return visit_precision(precision, [](auto trait) { return decltype(trait)::mantissa_bits; });
+}
+
+inline const char* precision_name(Precision precision)
+{
+    return visit_precision(precision, [](auto trait) { return decltype(trait)::name(); });
+}
+
+// Picks the cheapest precision that renders the view without artefacts.
+//
+// A view needs log2(max |coordinate| * scale) bits to tell neighbouring pixels apart
+// plus some guard bits for the rounding errors that pile up while iterating.
+// Switching to a more precise type happens as soon as it is needed, switching back
+// only once the cheaper type has hysteresis_bits to spare, so zooming back and forth
+// around a boundary does not make the kernel flap.
+class PrecisionDispatcher {
+
+public:
+    static constexpr int guard_bits = 10;
+    static constexpr int hysteresis_bits = 2;
+
+    explicit PrecisionDispatcher(Precision max_precision = Precision::Deep) : m_max_precision(max_precision) {}
+
+    Precision select(dvec2 offset, dvec2 scale, ivec2 size)
+    {
+        double required = required_bits(offset, scale, size);
+        Precision best = m_max_precision;
+
+        for (int i = 0; i <= int(m_max_precision); i++) {
+            Precision candidate = Precision(i);
+
+            // long double is just double on some compilers
+            if (i > 0 && mantissa_bits(candidate) <= mantissa_bits(Precision(i - 1))) {
+                continue;
+            }
+
+            int margin = i < int(m_current) ? hysteresis_bits : 0;
+
+            if (required + margin <= mantissa_bits(candidate)) {
+                best = candidate;
+                break;
+            }
+        }
+
+        m_current = best;
+        m_exhausted = required > mantissa_bits(best);
+        return m_current;
+    }
+
+    static double required_bits(dvec2 offset, dvec2 scale, ivec2 size)
+    {
+        dvec2 far_corner = offset + dvec2(size) / scale;
+
+        // the orbit itself moves within the bailout radius as well
+        double magnitude = std::max({ 2.0, std::abs(offset.x), std::abs(offset.y), std::abs(far_corner.x),
+            std::abs(far_corner.y) });
+
+        double pixels_per_unit = std::max(scale.x, scale.y);
+
+        return std::log2(magnitude * pixels_per_unit) + guard_bits;
+    }
+
+    Precision current() const { return m_current; }
+
+    Precision max_precision() const { return m_max_precision; }
+
+    // true if even the most precise type available is not enough for the view
+    bool exhausted() const { return m_exhausted; }
+
+private:
+    Precision m_max_precision;
+    Precision m_current { Precision::Float };
+    bool m_exhausted { false };
+};
+
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <Formula.hpp>
+#include <Precision.hpp>
+#include <Kernel.hpp>
+
+namespace mygl {
+
+// bins of FrameStats::escape_histogram, they split [0, max_iterations) evenly
+constexpr int ESCAPE_HISTOGRAM_BINS = 64;
+
+struct TileStats {
+    int x, y, w, h;
+    double ms;
+    uint64_t iterations;
+};
+
+// Where the iterations of one cpu frame went. Filled by TileScheduler and render_distance(),
+// workers collect into their own copy and merge() them once the frame is done.
+struct FrameStats {
+    ivec2 size { 0, 0 };
+    int max_iterations { 0 };
+    FormulaType formula { FormulaType::Mandelbrot };
+    bool julia { false };
+    Precision precision { Precision::Double };
+
+    // "tiles" or "distance"
+    const char* renderer { "" };
+
+    double frame_ms { 0.0 };
+
+    // formula steps actually computed
+    uint64_t iterations { 0 };
+
+    // steps a brute force render would have needed on top, for the pixels a shortcut filled in.
+    // Only measured when the renderer is asked for a cost map, 0 otherwise.
+    uint64_t saved_iterations { 0 };
+
+    // pixels that ran the kernel and pixels a shortcut filled in without it, together the whole frame
+    uint64_t computed_pixels { 0 };
+    uint64_t filled_pixels { 0 };
+
+    // of all pixels, filled pixels are proven to escape and count as escaped
+    uint64_t escaped_pixels { 0 };
+    uint64_t interior_pixels { 0 };
+
+    // computed escaped pixels by escape iteration, bin i counts [i * bin_width, (i + 1) * bin_width).
+    // Filled pixels have no escape iteration and are not in it.
+    int bin_width { 1 };
+    std::vector<uint64_t> escape_histogram;
+
+    std::vector<TileStats> tiles;
+
+    void reset(const View& view, const char* renderer_name)
+    {
+        *this = FrameStats {};
+        size = view.size;
+        max_iterations = view.max_iterations;
+        formula = view.formula;
+        julia = view.julia;
+        precision = view.precision;
+        renderer = renderer_name;
+        bin_width = std::max(1, (view.max_iterations + ESCAPE_HISTOGRAM_BINS - 1) / ESCAPE_HISTOGRAM_BINS);
+        escape_histogram.assign(ESCAPE_HISTOGRAM_BINS, 0);
+    }
+
+    // pixels a shortcut proved to be outside the set without running the kernel
+    void add_filled(uint64_t count)
+    {
+        filled_pixels += count;
+        escaped_pixels += count;
+    }
+
+    // one kernel evaluation that took n iterations
+    void add_pixel(int n)
+    {
+        iterations += uint64_t(n);
+        computed_pixels++;
+
+        if (n >= max_iterations) {
+            interior_pixels++;
+        } else {
+            escaped_pixels++;
+            escape_histogram[std::min(n / bin_width, ESCAPE_HISTOGRAM_BINS - 1)]++;
+        }
+    }
+
+    // adds the counters and tiles of a worker, the view must be the same
+    void merge(const FrameStats& other)
+    {
+        iterations += other.iterations;
+        saved_iterations += other.saved_iterations;
+        computed_pixels += other.computed_pixels;
+        filled_pixels += other.filled_pixels;
+        escaped_pixels += other.escaped_pixels;
+        interior_pixels += other.interior_pixels;
+
+        for (size_t i = 0; i < escape_histogram.size() && i < other.escape_histogram.size(); i++) {
+            escape_histogram[i] += other.escape_histogram[i];
+        }
+
+        tiles.insert(tiles.end(), other.tiles.begin(), other.tiles.end());
+    }
+
+    std::string to_json() const
+    {
+        std::string out;
+        char buffer[256];
+
+        auto append = [&](const char* format, auto... args) {
+            snprintf(buffer, sizeof(buffer), format, args...);
+            out += buffer;
+        };
+
+        out += "{\n";
+        append("  \"width\": %d,\n  \"height\": %d,\n", size.x, size.y);
+        append("  \"max_iterations\": %d,\n", max_iterations);
+        append("  \"formula\": \"%s\",\n  \"julia\": %s,\n", formula_name(formula), julia ? "true" : "false");
+        append("  \"precision\": \"%s\",\n  \"renderer\": \"%s\",\n", precision_name(precision), renderer);
+        append("  \"frame_ms\": %.3f,\n", frame_ms);
+        append("  \"iterations\": %llu,\n", (unsigned long long)iterations);
+        append("  \"saved_iterations\": %llu,\n", (unsigned long long)saved_iterations);
+        append("  \"computed_pixels\": %llu,\n", (unsigned long long)computed_pixels);
+        append("  \"filled_pixels\": %llu,\n", (unsigned long long)filled_pixels);
+        append("  \"escaped_pixels\": %llu,\n", (unsigned long long)escaped_pixels);
+        append("  \"interior_pixels\": %llu,\n", (unsigned long long)interior_pixels);
+        append("  \"escape_histogram\": {\n    \"bin_width\": %d,\n    \"counts\": [", bin_width);
+
+        for (size_t i = 0; i < escape_histogram.size(); i++) {
+            append(i == 0 ? "%llu" : ", %llu", (unsigned long long)escape_histogram[i]);
+        }
+
+        out += "]\n  },\n  \"tiles\": [";
+
+        for (size_t i = 0; i < tiles.size(); i++) {
+            const TileStats& tile = tiles[i];
+            append("%s\n    { \"x\": %d, \"y\": %d, \"w\": %d, \"h\": %d, \"ms\": %.4f, \"iterations\": %llu }",
+                i == 0 ? "" : ",", tile.x, tile.y, tile.w, tile.h, tile.ms, (unsigned long long)tile.iterations);
+        }
+
+        out += tiles.empty() ? "]\n}\n" : "\n  ]\n}\n";
+        return out;
+    }
+
+    bool write_json(const std::string& path) const
+    {
+        FILE* file = fopen(path.c_str(), "w");
+
+        if (!file) {
+            fprintf(stderr, "Cannot write %s\n", path.c_str());
+            return false;
+        }
+
+        std::string json = to_json();
+        bool ok = fwrite(json.data(), 1, json.size(), file) == json.size();
+        return fclose(file) == 0 && ok;
+    }
+};
+
+// glsl prelude for the cost heatmap (res/heatmap): `int cost(ivec2 pixel)` is the number of iterations
+// computed for the pixel, or -(iterations saved) - 1 for pixels a shortcut filled in.
+inline std::string glsl_texture_cost()
+{
+    std::string out;
+
+    out += "uniform int u_max_it;\n";
+    out += "uniform isampler2D u_iterations;\n";
+    out += "\n";
+    out += "int cost(ivec2 pixel)\n{\n";
+    out += "    return texelFetch(u_iterations, pixel, 0).r;\n";
+    out += "}\n";
+
+    return out;
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <SpscQueue.hpp>
+
+namespace mygl {
+
+// Runs the rendering on its own thread so the ui thread only has to handle input.
+//
+// The ui thread submit()s requests (usually a view), the render thread always picks up
+// the newest one and calls render() with it. A frame is stale as soon as a newer request
+// is queued: render() should poll cancelled() regularly and return without presenting
+// once it turns true.
+template<typename Request, size_t QueueSize = 64> class RenderThread {
+
+public:
+    using HookFn = std::function<void()>;
+    using RenderFn = std::function<void(const Request&)>;
+
+    RenderThread() = default;
+
+    ~RenderThread() { stop(); }
+
+    // init and shutdown run on the render thread, e.g. to make a context current
+    // and to create/destroy the objects that belong to it.
+    void start(HookFn init, RenderFn render, HookFn shutdown)
+    {
+        m_stop = false;
+        m_thread = std::thread([this, init, render, shutdown]() {
+            init();
+            loop(render);
+            shutdown();
+        });
+    }
+
+    void stop()
+    {
+        if (!m_thread.joinable()) {
+            return;
+        }
+
+        m_stop = true;
+        wake();
+        m_thread.join();
+    }
+
+    // ui thread only. Returns false if the queue is full, the caller should keep the
+    // request and submit it again later.
+    bool submit(const Request& request)
+    {
+        if (!m_queue.try_push(request)) {
+            return false;
+        }
+
+        wake();
+        return true;
+    }
+
+    // true once the frame being rendered is out of date
+    bool cancelled() const { return !m_queue.empty() || m_stop.load(std::memory_order_relaxed); }
+
+    uint64_t frames_started() const { return m_frames_started; }
+
+private:
+    void loop(const RenderFn& render)
+    {
+        Request request;
+
+        while (!m_stop) {
+            if (!m_queue.try_pop_latest(request)) {
+                // the queue itself never blocks, the mutex is only used to sleep while idle
+                std::unique_lock<std::mutex> lock(m_wake_mutex);
+                m_wake.wait(lock, [this]() { return !m_queue.empty() || m_stop; });
+                continue;
+            }
+
+            m_frames_started++;
+            render(request);
+        }
+    }
+
+    void wake()
+    {
+        // taking the lock orders the push before the check in the waiting predicate
+        { std::lock_guard<std::mutex> lock(m_wake_mutex); }
+        m_wake.notify_one();
+    }
+
+private:
+    SpscQueue<Request, QueueSize> m_queue;
+
+    std::thread m_thread;
+    std::atomic<bool> m_stop { false };
+    std::atomic<uint64_t> m_frames_started { 0 };
+
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+};
+
+}
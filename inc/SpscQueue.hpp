@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+#include <utility>
+
+namespace mygl {
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// head is only written by the consumer and tail only by the producer,
+// each on its own cache line so the two threads don't fight over it.
+template<typename T, size_t Capacity> class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() = default;
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer only, returns false if the queue is full
+    bool try_push(const T& value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+
+        m_items[tail & (Capacity - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only, returns false if the queue is empty
+    bool try_pop(T& value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(m_items[head & (Capacity - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only, pops everything and keeps the newest item
+    bool try_pop_latest(T& value)
+    {
+        bool any = false;
+
+        while (try_pop(value)) {
+            any = true;
+        }
+
+        return any;
+    }
+
+    // may be called from both threads, the answer can be stale by the time it is used
+    bool empty() const { return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire); }
+
+private:
+    alignas(64) std::atomic<size_t> m_head { 0 };
+    alignas(64) std::atomic<size_t> m_tail { 0 };
+    alignas(64) T m_items[Capacity];
+};
+
+}
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <Kernel.hpp>
+#include <RenderStats.hpp>
+
+namespace mygl {
+
+using namespace glm;
+
+// the frame starts out as a grid of TILE_SIZE tiles, expensive ones are split down to MIN_TILE_SIZE
+constexpr int TILE_SIZE = 64;
+constexpr int MIN_TILE_SIZE = 16;
+
+// resolution of the cost map, tile edges are always a multiple of it (except at the border of the frame)
+constexpr int COST_CELL_SIZE = 8;
+
+// tiles estimated to take more than 1 / (threads * TILES_PER_THREAD) of the frame get split
+constexpr int TILES_PER_THREAD = 4;
+
+// fixed cost of a pixel in iterations (coordinates, store), keeps pixels that escape at once from being free
+constexpr double PIXEL_COST = 2.0;
+
+struct Tile {
+    int x, y, w, h;
+    double cost;
+};
+
+// Iteration counts of the last complete frame summed per COST_CELL_SIZE cell, together with the view
+// they were rendered for. A new view looks up its cost through the old one: screen -> world -> old screen.
+class CostMap {
+
+public:
+    void reset(const View& view)
+    {
+        m_view = view;
+        m_cells = ivec2((view.size + COST_CELL_SIZE - 1) / COST_CELL_SIZE);
+        m_sums.assign(size_t(m_cells.x) * size_t(m_cells.y), 0.0);
+        m_valid = false;
+    }
+
+    // adds a rendered tile, cells are never shared between tiles so workers don't need to synchronize
+    void add(int x0, int y0, int w, int h, const int* tile, size_t stride)
+    {
+        for (int y = 0; y < h; y++) {
+            const int* row = tile + size_t(y) * stride;
+            double* sums = &m_sums[size_t((y0 + y) / COST_CELL_SIZE) * size_t(m_cells.x)];
+
+            for (int x = 0; x < w; x++) {
+                sums[(x0 + x) / COST_CELL_SIZE] += double(row[x]) + PIXEL_COST;
+            }
+        }
+    }
+
+    void finish()
+    {
+        double total = 0.0;
+        for (double sum : m_sums) {
+            total += sum;
+        }
+
+        m_mean = total / std::max(1.0, double(m_view.size.x) * double(m_view.size.y));
+        m_valid = true;
+    }
+
+    // the counts only say something about views of the same fractal
+    bool usable_for(const View& view) const
+    {
+        return m_valid && view.formula == m_view.formula && view.julia == m_view.julia
+            && view.julia_c == m_view.julia_c && view.max_iterations == m_view.max_iterations;
+    }
+
+    // cost of the w x h pixels at (x0, y0) of view, sampled once per cell.
+    // Parts that were not on screen in the old view get the old mean.
+    double estimate(const View& view, int x0, int y0, int w, int h) const
+    {
+        // world = screen / scale + offset, offsets are subtracted first so deep views stay exact enough
+        dvec2 shift = offset_difference(view) * m_view.scale;
+        dvec2 ratio = m_view.scale / view.scale;
+
+        double cost = 0.0;
+
+        for (int y = y0; y < y0 + h; y += COST_CELL_SIZE) {
+            int sample_h = std::min(COST_CELL_SIZE, y0 + h - y);
+
+            for (int x = x0; x < x0 + w; x += COST_CELL_SIZE) {
+                int sample_w = std::min(COST_CELL_SIZE, x0 + w - x);
+
+                dvec2 center = dvec2(x + sample_w * 0.5, y + sample_h * 0.5);
+                dvec2 old_pos = center * ratio + shift;
+
+                cost += cost_per_pixel(old_pos) * double(sample_w * sample_h);
+            }
+        }
+
+        return cost;
+    }
+
+private:
+    // Deep kernels render from deep_offset, the double offset can't even tell neighbouring views apart
+    // there. The others render from the double offset, so its difference is exactly what was rendered.
+    dvec2 offset_difference(const View& view) const
+    {
+        if (view.precision == Precision::Deep || m_view.precision == Precision::Deep) {
+            return { double(view.deep_offset.re - m_view.deep_offset.re),
+                double(view.deep_offset.im - m_view.deep_offset.im) };
+        }
+
+        return view.offset - m_view.offset;
+    }
+
+    double cost_per_pixel(dvec2 pos) const
+    {
+        if (pos.x < 0.0 || pos.y < 0.0 || pos.x >= m_view.size.x || pos.y >= m_view.size.y) {
+            return m_mean;
+        }
+
+        int cx = int(pos.x) / COST_CELL_SIZE;
+        int cy = int(pos.y) / COST_CELL_SIZE;
+
+        // cells at the right and bottom border may be cut off
+        int w = std::min(COST_CELL_SIZE, m_view.size.x - cx * COST_CELL_SIZE);
+        int h = std::min(COST_CELL_SIZE, m_view.size.y - cy * COST_CELL_SIZE);
+
+        return m_sums[size_t(cy) * size_t(m_cells.x) + size_t(cx)] / double(w * h);
+    }
+
+private:
+    View m_view;
+    ivec2 m_cells { 0, 0 };
+    std::vector<double> m_sums;
+    double m_mean { 0.0 };
+    bool m_valid { false };
+};
+
+// how well the work of the last frame was spread over the workers
+struct ScheduleStats {
+    size_t threads { 0 };
+    size_t tiles { 0 };
+
+    // tiles that exist because a bigger one was split
+    size_t split_tiles { 0 };
+
+    // false if there was no usable previous frame and all pixels were assumed to cost the same
+    bool estimated { false };
+
+    double frame_ms { 0.0 };
+
+    // time each worker spent rendering tiles
+    double busy_mean_ms { 0.0 };
+    double busy_max_ms { 0.0 };
+
+    // time between the first and the last worker running out of tiles
+    double tail_ms { 0.0 };
+
+    // 1 is perfect, 2 means the slowest worker took twice as long as the average
+    double imbalance() const { return busy_mean_ms > 0.0 ? busy_max_ms / busy_mean_ms : 1.0; }
+};
+
+// Splits cpu frames into tiles and hands them out longest first.
+//
+// Interactive frames are mostly small moves or zooms of the previous one, so the iteration counts of
+// the last frame, warped to the new view, are a good guess for what each tile will cost. Tiles that
+// would take longer than their share are split, the rest are sorted by cost: the expensive tiles
+// around the boundary start first and the cheap ones fill the gaps at the end, instead of one worker
+// still grinding through the boundary while the others are idle.
+//
+// The workers are a pool started once with the scheduler and woken for every frame. Each is pinned to one
+// cpu (linux) and renders into a tile buffer it allocates itself, so the buffer is first touched, and
+// therefore placed, on its own numa node and stays there from frame to frame. Only finished rows are
+// copied into the frame.
+class TileScheduler {
+
+public:
+    TileScheduler()
+    {
+#if defined(__linux__)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    m_cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        m_num_threads = m_cpus.empty() ? int(std::max(1u, std::thread::hardware_concurrency())) : int(m_cpus.size());
+
+        m_tile_buffers.resize(size_t(m_num_threads));
+        m_workers.reserve(size_t(m_num_threads));
+
+        for (int i = 0; i < m_num_threads; i++) {
+            m_workers.emplace_back([this, i]() { worker_loop(i); });
+        }
+    }
+
+    TileScheduler(const TileScheduler&) = delete;
+    TileScheduler& operator=(const TileScheduler&) = delete;
+
+    ~TileScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+
+        m_wake.notify_all();
+
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    // renders the view into out (row major, view.size.x wide). Returns false if it was cancelled,
+    // the cost map of the previous frame is kept in that case.
+    bool render(const View& view, int* out, const CancelFn& cancelled = {})
+    {
+        using clock = std::chrono::steady_clock;
+        auto frame_start = clock::now();
+
+        m_stats = ScheduleStats {};
+        m_stats.threads = size_t(m_num_threads);
+        m_stats.estimated = m_previous.usable_for(view);
+
+        schedule(view);
+
+        m_current.reset(view);
+
+        std::atomic<size_t> next_tile { 0 };
+        std::atomic<bool> complete { true };
+        std::vector<double> busy(m_num_threads, 0.0), finished(m_num_threads, 0.0);
+        std::vector<FrameStats> worker_stats(m_num_threads);
+
+        m_frame_stats.reset(view, "tiles");
+
+        visit_kernel(view, [&](auto formula, auto is_julia, auto precision) {
+            using Formula = decltype(formula);
+            using T = typename decltype(precision)::Type;
+            constexpr bool Julia = decltype(is_julia)::value;
+
+            run_workers([&](int i) {
+                std::vector<int>& tile_buffer = m_tile_buffers[size_t(i)];
+
+                FrameStats& local = worker_stats[i];
+                local.reset(view, "tiles");
+
+                for (size_t t = next_tile++; t < m_tiles.size(); t = next_tile++) {
+                    if (cancelled && cancelled()) {
+                        complete = false;
+                        break;
+                    }
+
+                    const Tile& tile = m_tiles[t];
+                    auto tile_start = clock::now();
+
+                    render_tile<Formula, Julia, T>(
+                        view, tile_buffer.data(), TILE_SIZE, tile.x, tile.y, tile.w, tile.h);
+
+                    for (int y = 0; y < tile.h; y++) {
+                        memcpy(out + size_t(tile.y + y) * size_t(view.size.x) + size_t(tile.x),
+                            tile_buffer.data() + size_t(y) * TILE_SIZE, size_t(tile.w) * sizeof(int));
+                    }
+
+                    m_current.add(tile.x, tile.y, tile.w, tile.h, tile_buffer.data(), TILE_SIZE);
+
+                    // every pixel costs exactly its escape time here
+                    uint64_t iterations_before = local.iterations;
+
+                    for (int y = 0; y < tile.h; y++) {
+                        for (int x = 0; x < tile.w; x++) {
+                            local.add_pixel(tile_buffer[size_t(y) * TILE_SIZE + size_t(x)]);
+                        }
+                    }
+
+                    double ms = std::chrono::duration<double, std::milli>(clock::now() - tile_start).count();
+                    local.tiles.push_back({ tile.x, tile.y, tile.w, tile.h, ms, local.iterations - iterations_before });
+                    busy[i] += ms;
+                }
+
+                finished[i] = std::chrono::duration<double, std::milli>(clock::now() - frame_start).count();
+            });
+        });
+
+        m_stats.frame_ms = std::chrono::duration<double, std::milli>(clock::now() - frame_start).count();
+
+        for (const FrameStats& local : worker_stats) {
+            m_frame_stats.merge(local);
+        }
+
+        m_frame_stats.frame_ms = m_stats.frame_ms;
+        m_stats.busy_max_ms = *std::max_element(busy.begin(), busy.end());
+        m_stats.tail_ms = *std::max_element(finished.begin(), finished.end())
+            - *std::min_element(finished.begin(), finished.end());
+
+        for (double b : busy) {
+            m_stats.busy_mean_ms += b / double(m_num_threads);
+        }
+
+        if (!complete) {
+            return false;
+        }
+
+        m_current.finish();
+        std::swap(m_previous, m_current);
+        return true;
+    }
+
+    // of the last call to render()
+    const ScheduleStats& stats() const { return m_stats; }
+
+    // where the iterations of the last frame went, per pixel the cost is the iteration count in out
+    const FrameStats& frame_stats() const { return m_frame_stats; }
+
+    int num_threads() const { return m_num_threads; }
+
+private:
+    // runs job(worker index) once on every worker and waits for all of them
+    void run_workers(const std::function<void(int)>& job)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_running = m_num_threads;
+        m_generation++;
+        m_wake.notify_all();
+
+        m_done.wait(lock, [this]() { return m_running == 0; });
+        m_job = nullptr;
+    }
+
+    void worker_loop(int worker)
+    {
+        pin_to_cpu(worker);
+
+        // allocated on the worker, after pinning, for the first touch placement
+        m_tile_buffers[size_t(worker)].assign(size_t(TILE_SIZE) * size_t(TILE_SIZE), 0);
+
+        uint64_t generation = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (true) {
+            m_wake.wait(lock, [&]() { return m_quit || m_generation != generation; });
+
+            if (m_quit) {
+                return;
+            }
+
+            generation = m_generation;
+            const std::function<void(int)>& job = *m_job;
+
+            lock.unlock();
+            job(worker);
+            lock.lock();
+
+            if (--m_running == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    void schedule(const View& view)
+    {
+        m_tiles.clear();
+
+        for (int y = 0; y < view.size.y; y += TILE_SIZE) {
+            for (int x = 0; x < view.size.x; x += TILE_SIZE) {
+                int w = std::min(TILE_SIZE, view.size.x - x);
+                int h = std::min(TILE_SIZE, view.size.y - y);
+                m_tiles.push_back({ x, y, w, h, estimate(view, x, y, w, h) });
+            }
+        }
+
+        double total = 0.0;
+        for (const Tile& tile : m_tiles) {
+            total += tile.cost;
+        }
+
+        double max_cost = total / double(m_num_threads * TILES_PER_THREAD);
+        size_t num_grid_tiles = m_tiles.size();
+
+        // split in place, the new tiles are appended and checked again
+        for (size_t i = 0; i < m_tiles.size(); i++) {
+            while (m_tiles[i].cost > max_cost && std::min(m_tiles[i].w, m_tiles[i].h) > MIN_TILE_SIZE) {
+                Tile tile = m_tiles[i];
+
+                // halves are rounded to whole cost cells
+                int w0 = std::max(MIN_TILE_SIZE, (tile.w / 2 + COST_CELL_SIZE - 1) / COST_CELL_SIZE * COST_CELL_SIZE);
+                int h0 = std::max(MIN_TILE_SIZE, (tile.h / 2 + COST_CELL_SIZE - 1) / COST_CELL_SIZE * COST_CELL_SIZE);
+
+                m_tiles[i] = { tile.x, tile.y, w0, h0, estimate(view, tile.x, tile.y, w0, h0) };
+
+                if (tile.w > w0) {
+                    m_tiles.push_back(
+                        { tile.x + w0, tile.y, tile.w - w0, h0, estimate(view, tile.x + w0, tile.y, tile.w - w0, h0) });
+                }
+
+                if (tile.h > h0) {
+                    m_tiles.push_back(
+                        { tile.x, tile.y + h0, w0, tile.h - h0, estimate(view, tile.x, tile.y + h0, w0, tile.h - h0) });
+                }
+
+                if (tile.w > w0 && tile.h > h0) {
+                    m_tiles.push_back({ tile.x + w0, tile.y + h0, tile.w - w0, tile.h - h0,
+                        estimate(view, tile.x + w0, tile.y + h0, tile.w - w0, tile.h - h0) });
+                }
+            }
+        }
+
+        m_stats.tiles = m_tiles.size();
+        m_stats.split_tiles = m_tiles.size() - num_grid_tiles;
+
+        std::stable_sort(
+            m_tiles.begin(), m_tiles.end(), [](const Tile& a, const Tile& b) { return a.cost > b.cost; });
+    }
+
+    double estimate(const View& view, int x, int y, int w, int h) const
+    {
+        return m_stats.estimated ? m_previous.estimate(view, x, y, w, h) : double(w * h);
+    }
+
+    void pin_to_cpu(int worker)
+    {
+#if defined(__linux__)
+        if (m_cpus.empty()) {
+            return;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(m_cpus[size_t(worker) % m_cpus.size()], &set);
+
+        // best effort, the worker just floats if it fails
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)worker;
+#endif
+    }
+
+private:
+    int m_num_threads { 1 };
+    std::vector<int> m_cpus;
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::vector<int>> m_tile_buffers;
+
+    // the job of the current frame, workers run it once per generation
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(int)>* m_job { nullptr };
+    uint64_t m_generation { 0 };
+    int m_running { 0 };
+    bool m_quit { false };
+
+    std::vector<Tile> m_tiles;
+
+    // written by the frame being rendered, swapped once it is complete
+    CostMap m_previous;
+    CostMap m_current;
+
+    ScheduleStats m_stats;
+    FrameStats m_frame_stats;
+};
+
+}
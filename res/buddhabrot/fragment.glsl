@@ -0,0 +1,13 @@
+#version 400 core
+precision highp float;
+
+layout (origin_upper_left, pixel_center_integer) in vec4 gl_FragCoord;
+
+// `float density(ivec2 pixel)` comes from the prelude generated by glsl_texture_density(),
+// the orbit density scaled to [0, 1].
+
+void main()
+{
+    float v = pow(density(ivec2(gl_FragCoord.xy)), 0.4);
+    gl_FragColor = vec4(pow(v, 1.3), v, pow(v, 0.7), 1.0);
+}
@@ -0,0 +1,19 @@
+#version 400 core
+precision highp float;
+
+layout (origin_upper_left, pixel_center_integer) in vec4 gl_FragCoord;
+
+// `float distance_estimate(ivec2 pixel)` comes from the prelude generated by glsl_texture_distance(),
+// it is the distance to the set in pixels and negative inside.
+
+void main()
+{
+    float d = distance_estimate(ivec2(gl_FragCoord.xy));
+
+    if (d < 0.0) {
+        gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+    } else {
+        float v = pow(clamp(d / 64.0, 0.0, 1.0), 0.25);
+        gl_FragColor = vec4(v, v * 0.9 + 0.1 * v * v, v * v, 1.0);
+    }
+}
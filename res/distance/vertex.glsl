@@ -0,0 +1,7 @@
+#version 330 core
+
+layout (location = 0) in vec2 position;
+
+void main() {
+    gl_Position = vec4(position, 0.0, 1.0);
+}
\ No newline at end of file
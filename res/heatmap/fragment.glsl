@@ -0,0 +1,27 @@
+#version 400 core
+precision highp float;
+
+layout (origin_upper_left, pixel_center_integer) in vec4 gl_FragCoord;
+
+// `int cost(ivec2 pixel)` and u_max_it come from the prelude generated by glsl_texture_cost(): the iterations
+// computed for the pixel, or -(iterations saved) - 1 where a shortcut filled it in.
+
+// black - red - yellow - white
+vec3 heat(float t)
+{
+    return clamp(vec3(3.0 * t, 3.0 * t - 1.0, 3.0 * t - 2.0), 0.0, 1.0);
+}
+
+void main()
+{
+    int c = cost(ivec2(gl_FragCoord.xy));
+    float scale = 1.0 / log(float(u_max_it) + 1.0);
+
+    if (c < 0) {
+        // skipped, the brighter the blue the more it saved
+        float saved = log(float(-c)) * scale;
+        gl_FragColor = vec4(0.0, 0.25 * saved, 0.2 + 0.8 * saved, 1.0);
+    } else {
+        gl_FragColor = vec4(heat(log(float(c) + 1.0) * scale), 1.0);
+    }
+}
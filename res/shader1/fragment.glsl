@@ -3,30 +3,12 @@ precision highp float;
 
 layout (origin_upper_left, pixel_center_integer) in vec4 gl_FragCoord;
 
-uniform dvec2 u_one_over_scale;
-uniform dvec2 u_offset;
-
-uniform int u_max_it; 
+// u_max_it and `int iterate(ivec2 pixel)` come from the kernel prelude
+// generated by glsl_kernel() / glsl_texture_kernel().
 
 void main()
 {
-    dvec2 z = dvec2(0.0, 0.0);
-    dvec2 c = dvec2(gl_FragCoord.xy) * u_one_over_scale + u_offset;
-
-    int n = 0;
-
-    while (true) {
-        double x_sq = z.x*z.x;
-        double y_sq = z.y*z.y;
-
-        z = dvec2(x_sq - y_sq + c.x, 2.0 * z.x * z.y + c.y); // z = z² + c
-
-        if (x_sq + y_sq > 4.0 || n >= u_max_it) {
-            break;
-        }
-
-        n++;
-    } 
+    int n = iterate(ivec2(gl_FragCoord.xy));
 
     if (n == u_max_it) n = 0;
     float col_g = float(n) / float(u_max_it) * 10.0;
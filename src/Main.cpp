@@ -1,75 +1,149 @@
 
 #include <MyGL.hpp>
 #include <GLFWApplication.hpp>
+#include <Formula.hpp>
+#include <Kernel.hpp>
+#include <Precision.hpp>
+#include <RenderThread.hpp>
+#include <FixedLimb.hpp>
+#include <DistanceEstimator.hpp>
+#include <TileScheduler.hpp>
+#include <Buddhabrot.hpp>
+#include <RenderStats.hpp>
+#include <ExpMap.hpp>
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
 
 using namespace mygl;
 
 constexpr size_t NUM_SHADERS = 3;
+constexpr int STRIP_HEIGHT = 64;
+constexpr size_t PIXEL_BUFFER_SLOTS = 3;
+
+// a still buddhabrot view keeps accumulating up to this many orbits
+constexpr uint64_t BUDDHABROT_MAX_ORBITS = 10000000000ull;
+
+// written by the T key
+constexpr const char* FRAME_STATS_PATH = "frame_stats.json";
+
+// the V key zooms this far into the point under the mouse, played back at ZOOM_VIDEO_FPS
+constexpr double ZOOM_VIDEO_DEPTH = 1e4;
+constexpr int ZOOM_VIDEO_FRAMES = 600;
+constexpr double ZOOM_VIDEO_FPS = 60.0;
+
+// a copy of everything the render thread needs for one frame
+struct Frame {
+    View view;
+    size_t shader_idx { 0 };
+    bool cpu_rendering { false };
+    bool distance_shading { false };
+    bool buddhabrot { false };
+    bool heatmap { false };
+    bool print_schedule { false };
+
+    // render zoom_path through an exponential map and play it in a loop, instead of view
+    bool zoom_video { false };
+    ZoomPath zoom_path;
+
+    // newest input event the frame includes, for the latency stats
+    uint64_t input_serial { 0 };
+};
 
 class MyApp : public GLFWApplication {
 
 public:
     MyApp() { m_name = "Mandelbrot"; }
 
+    // the ui thread only handles input and submits frames,
+    // the render thread owns the context and does all the drawing.
     void run() override
     {
-        offset = -screen_to_world(window_size() / 2);
+        move_offset(-dvec2(window_size() / 2) / scale);
 
-        float vertices[] {
-            -1.0f, 1.0f, //
-            1.0f, 1.0f,  //
-            1.0f, -1.0f, //
+        glfwMakeContextCurrent(nullptr);
 
-            -1.0f, 1.0f,  //
-            -1.0f, -1.0f, //
-            1.0f, -1.0f,  //
-        };
-
-        VertexBuffer buffer(vertices, sizeof(vertices));
-
-        VertexLayout layout;
-        layout.push<float>(2);
+        renderer.start([this]() { render_init(); }, [this](const Frame& frame) { render_frame(frame); },
+            [this]() { render_shutdown(); });
 
-        VertexArray varray;
-        varray.add_buffer(buffer, layout);
+        redraw();
 
-        Shader shader1 = load_shader("res/shader1");
-        Shader shader2 = load_shader("res/shader2");
-        Shader shader3 = load_shader("res/shader3");
+        while (!glfwWindowShouldClose(m_window)) {
+            wait_events(frame_pending ? 0.001 : -1.0);
 
-        shaders[0] = &shader1;
-        shaders[1] = &shader2;
-        shaders[2] = &shader3;
+            submit_pending();
+        }
 
-        varray.bind();
+        renderer.stop();
+    }
 
-        shader1.bind();
-        shader1.set_uniform<int>("u_max_it", max_iterations);
-        shader2.bind();
-        shader2.set_uniform<int>("u_max_it", max_iterations);
-        shader3.bind();
-        shader3.set_uniform<int>("u_max_it", max_iterations);
+    void redraw()
+    {
+        select_precision();
 
-        redraw();
+        pending_frame = current_frame();
+        pending_frame.input_serial = request_frame();
+        frame_pending = true;
+        submit_pending();
+    }
 
-        while (!glfwWindowShouldClose(m_window)) {
-            glfwPollEvents();
+    // the queue only fills up if the render thread is stuck, keep the frame until it is taken
+    void submit_pending()
+    {
+        if (frame_pending && renderer.submit(pending_frame)) {
+            frame_pending = false;
         }
     }
 
-    void redraw()
+    // the dispatchers are stateful (hysteresis), the cpu one may go beyond what glsl can do
+    void select_precision()
     {
-        current_shader()->bind();
-        current_shader()->set_uniform("u_one_over_scale", 1.0 / scale);
-        current_shader()->set_uniform("u_offset", offset);
+        PrecisionDispatcher& dispatcher = renders_on_cpu() ? cpu_precision : gpu_precision;
+        Precision selected = dispatcher.select(offset, scale, window_size());
 
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (selected != precision) {
+            precision = selected;
+            printf("precision: %s\n", precision_name(precision));
+        }
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        if (dispatcher.exhausted() && !precision_warning) {
+            printf("warning: %s is not precise enough for this zoom\n", precision_name(precision));
+        }
 
-        glfwSwapBuffers(m_window);
+        precision_warning = dispatcher.exhausted();
+    }
+
+    Frame current_frame()
+    {
+        Frame frame;
+        frame.view.offset = offset;
+        frame.view.deep_offset = deep_offset;
+        frame.view.scale = scale;
+        frame.view.size = window_size();
+        frame.view.max_iterations = max_iterations;
+        frame.view.formula = formula;
+        frame.view.julia = julia;
+        frame.view.julia_c = julia_c;
+        frame.view.precision = precision;
+        frame.shader_idx = shader_idx;
+        frame.cpu_rendering = renders_on_cpu();
+        frame.distance_shading = distance_shading;
+        frame.buddhabrot = buddhabrot;
+        frame.heatmap = heatmap;
+        frame.print_schedule = print_schedule;
+        return frame;
     }
 
+    // the distance estimator, the buddhabrot and the cost heatmap only exist on the cpu
+    bool renders_on_cpu() const { return cpu_rendering || distance_shading || buddhabrot || heatmap; }
+
+    // resumes from and periodically writes to path, must be set before run()
+    void set_buddhabrot_checkpoint(const std::string& path) { buddhabrot_settings.checkpoint_path = path; }
+
     void mouse_event(MouseEvent event) override
     {
         if (event.action == MouseAction::Press) {
@@ -83,7 +157,7 @@ public:
     void cursor_event(dvec2 pos) override
     {
         if (dragging) {
-            offset -= (pos - drag_pos) / scale;
+            move_offset(-(pos - drag_pos) / scale);
             drag_pos = pos;
             redraw();
         }
@@ -100,14 +174,49 @@ public:
                 redraw();
             } else if (event.key == Key::KeyUp) {
                 max_iterations += 500;
-                current_shader()->set_uniform("u_max_it", max_iterations);
                 redraw();
                 printf("max_iterations: %d\n", max_iterations);
             } else if (event.key == Key::KeyDown) {
                 max_iterations -= 500;
-                current_shader()->set_uniform("u_max_it", max_iterations);
                 redraw();
                 printf("max_iterations: %d\n", max_iterations);
+            } else if (event.key == Key::KeyF) {
+                formula = FormulaType((int(formula) + 1) % int(FormulaType::Count));
+                redraw();
+                printf("formula: %s\n", formula_name(formula));
+            } else if (event.key == Key::KeyJ) {
+                julia = !julia;
+                julia_c = screen_to_world(mouse_pos());
+                redraw();
+                printf("julia: %s c = (%f, %f)\n", julia ? "on" : "off", julia_c.x, julia_c.y);
+            } else if (event.key == Key::KeyC) {
+                cpu_rendering = !cpu_rendering;
+                redraw();
+                printf("rendering on: %s\n", cpu_rendering ? "cpu" : "gpu");
+            } else if (event.key == Key::KeyD) {
+                distance_shading = !distance_shading;
+                redraw();
+                printf("distance shading: %s\n", distance_shading ? "on" : "off");
+            } else if (event.key == Key::KeyB) {
+                buddhabrot = !buddhabrot;
+                redraw();
+                printf("buddhabrot: %s\n", buddhabrot ? "on" : "off");
+            } else if (event.key == Key::KeyH) {
+                heatmap = !heatmap;
+                redraw();
+                printf("cost heatmap: %s\n", heatmap ? "on" : "off");
+            } else if (event.key == Key::KeyT) {
+                if (renders_on_cpu() && !buddhabrot) {
+                    dump_stats = true;
+                    redraw();
+                } else {
+                    printf("frame stats are only collected for cpu frames (C, D or H)\n");
+                }
+            } else if (event.key == Key::KeyV) {
+                start_zoom_video();
+            } else if (event.key == Key::KeyS) {
+                print_schedule = !print_schedule;
+                printf("schedule stats: %s\n", print_schedule ? "on" : "off");
             }
         } else if (event.action == KeyAction::Repeat) {
             if (event.key == Key::KeyA) {
@@ -119,40 +228,449 @@ public:
         }
     }
 
+    // The video is centered on the point under the mouse, it starts at the current zoom and ends ZOOM_VIDEO_DEPTH
+    // times deeper.
+    // Any other input submits a regular frame and stops it.
+    void start_zoom_video()
+    {
+        ivec2 size = window_size();
+        dvec2 mouse = mouse_pos();
+
+        pending_frame = current_frame();
+        ZoomPath& path = pending_frame.zoom_path;
+        path.center = screen_to_world(mouse);
+        path.deep_center.re = deep_offset.re + DeepReal(mouse.x / scale.x);
+        path.deep_center.im = deep_offset.im + DeepReal(mouse.y / scale.y);
+        path.start_radius = 0.5 * length(dvec2(size)) / scale.x;
+        path.end_radius = path.start_radius / ZOOM_VIDEO_DEPTH;
+        path.frames = ZOOM_VIDEO_FRAMES;
+
+        // the last frame needs the most precision, a fresh dispatcher has no hysteresis to carry over
+        dvec2 end_scale = scale * ZOOM_VIDEO_DEPTH;
+        pending_frame.view.precision
+            = PrecisionDispatcher().select(path.center - dvec2(size) * 0.5 / end_scale, end_scale, size);
+
+        pending_frame.zoom_video = true;
+        pending_frame.cpu_rendering = true;
+        pending_frame.distance_shading = false;
+        pending_frame.buddhabrot = false;
+        pending_frame.heatmap = false;
+        pending_frame.input_serial = request_frame();
+        frame_pending = true;
+        submit_pending();
+
+        printf("zoom video: %d frames into (%.17g, %.17g), %s\n", path.frames, path.center.x, path.center.y,
+            precision_name(pending_frame.view.precision));
+    }
+
     void zoom(double factor)
     {
         dvec2 mouse = mouse_pos();
-        dvec2 pre_mouse = screen_to_world(mouse);
+        dvec2 old_scale = scale;
 
         scale *= factor;
 
-        dvec2 post_mouse = screen_to_world(mouse);
-        offset += pre_mouse - post_mouse;
+        // keep the point under the mouse in place, computed as a difference
+        // so it stays exact relative to the (possibly tiny) pixel size
+        move_offset(mouse / old_scale - mouse / scale);
 
         redraw();
     }
 
+    // offset is only ever moved by small deltas, the deep copy accumulates them
+    // exactly so deep cpu renders still know where they are.
+    void move_offset(dvec2 delta)
+    {
+        offset += delta;
+        deep_offset.re = deep_offset.re + DeepReal(delta.x);
+        deep_offset.im = deep_offset.im + DeepReal(delta.y);
+    }
+
     void scroll_event(dvec2 off) override
     {
         zoom(off.y < 0.0 ? 0.9 : 1.1);
     }
 
-    void resize_event(ivec2 size) override
+    void resize_event(ivec2 /*size*/) override { redraw(); }
+
+    // everything below runs on the render thread
+
+    void render_init()
+    {
+        glfwMakeContextCurrent(m_window);
+
+        float vertices[] {
+            -1.0f, 1.0f, //
+            1.0f, 1.0f,  //
+            1.0f, -1.0f, //
+
+            -1.0f, 1.0f,  //
+            -1.0f, -1.0f, //
+            1.0f, -1.0f,  //
+        };
+
+        quad_buffer = std::make_unique<VertexBuffer>(vertices, sizeof(vertices));
+
+        VertexLayout layout;
+        layout.push<float>(2);
+
+        quad_array = std::make_unique<VertexArray>();
+        quad_array->add_buffer(*quad_buffer, layout);
+        quad_array->bind();
+
+        iterations_texture = std::make_unique<Texture>();
+        iterations_buffer = std::make_unique<PixelBuffer>();
+    }
+
+    void render_shutdown()
     {
-        glViewport(0, 0, size.x, size.y);
-        redraw();
+        shaders.clear();
+        iterations_buffer.reset();
+        iterations_texture.reset();
+        quad_array.reset();
+        quad_buffer.reset();
+
+        glfwMakeContextCurrent(nullptr);
     }
 
-    Shader load_shader(std::string folder_path)
+    void render_frame(const Frame& frame)
+    {
+        const View& view = frame.view;
+
+        if (view.size.x <= 0 || view.size.y <= 0) {
+            return;
+        }
+
+        glViewport(0, 0, view.size.x, view.size.y);
+
+        Shader& shader = shader_for(frame, view.precision);
+        shader.bind();
+        shader.set_uniform("u_max_it", view.max_iterations);
+
+        if (frame.buddhabrot) {
+            render_buddhabrot(frame, shader);
+            return;
+        }
+
+        if (frame.zoom_video) {
+            render_zoom_video(frame, shader);
+            return;
+        }
+
+        if (frame.cpu_rendering) {
+            if (!render_cpu(frame)) {
+                return;
+            }
+
+            iterations_texture->bind(0);
+            shader.set_uniform("u_iterations", 0);
+        } else {
+            shader.set_uniform("u_one_over_scale", 1.0 / view.scale);
+            shader.set_uniform("u_offset", view.offset);
+            shader.set_uniform("u_julia_c", view.julia_c);
+        }
+
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // a newer view is waiting: the half drawn back buffer is never presented
+        if (!draw_strips(view.size) || renderer.cancelled()) {
+            return;
+        }
+
+        glfwSwapBuffers(m_window);
+        frame_presented(frame.input_serial);
+    }
+
+    // Draws the quad in horizontal strips and checks for a newer view after each one,
+    // a single draw call could keep the gpu busy for seconds. One strip is queued
+    // while waiting for the previous one, so the gpu does not run dry in between.
+    bool draw_strips(ivec2 size)
+    {
+        glEnable(GL_SCISSOR_TEST);
+
+        GLsync previous = nullptr;
+        bool cancelled = false;
+
+        for (int y = 0; y < size.y && !cancelled; y += STRIP_HEIGHT) {
+            glScissor(0, y, size.x, STRIP_HEIGHT);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            if (previous) {
+                glClientWaitSync(previous, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(previous);
+            }
+
+            previous = fence;
+            cancelled = renderer.cancelled();
+        }
+
+        if (previous) {
+            glDeleteSync(previous);
+        }
+
+        glDisable(GL_SCISSOR_TEST);
+
+        return !cancelled;
+    }
+
+    // The worker threads write straight into a slot of the mapped pixel buffer, the texture
+    // is the front buffer and keeps the last complete frame. A cancelled frame leaves the
+    // slot unfenced, so the next frame simply overwrites it.
+    bool render_cpu(const Frame& frame)
+    {
+        const View& view = frame.view;
+        void* back = map_cpu_frame(view.size);
+        auto cancelled = [this]() { return renderer.cancelled(); };
+
+        bool complete;
+
+        if (frame.distance_shading && frame.heatmap) {
+            // the costs go to the texture, the distances are not shown. The renderer adds to the costs it
+            // already stored, so they are built in ordinary memory and copied into the write combined slot.
+            size_t pixels = size_t(view.size.x) * size_t(view.size.y);
+            distance_scratch.resize(pixels);
+            cost_scratch.resize(pixels);
+            complete = render_distance(view, distance_scratch.data(), cancelled, &frame_stats, cost_scratch.data());
+
+            if (complete) {
+                memcpy(back, cost_scratch.data(), pixels * sizeof(int));
+            }
+        } else if (frame.distance_shading) {
+            // the distance is stored as float bits in the same integer texture
+            complete = render_distance(view, static_cast<float*>(back), cancelled, &frame_stats);
+        } else {
+            // the iteration counts double as the cost heatmap
+            complete = scheduler.render(view, static_cast<int*>(back), cancelled);
+            frame_stats = scheduler.frame_stats();
+        }
+
+        if (!complete) {
+            return false;
+        }
+
+        if (frame.print_schedule) {
+            if (!frame.distance_shading) {
+                print_schedule_stats(scheduler.stats());
+            }
+
+            print_frame_stats(frame_stats);
+        }
+
+        if (dump_stats.exchange(false) && frame_stats.write_json(FRAME_STATS_PATH)) {
+            printf("frame stats written to %s\n", FRAME_STATS_PATH);
+        }
+
+        upload_cpu_frame(view.size);
+        return true;
+    }
+
+    void print_frame_stats(const FrameStats& stats)
+    {
+        printf("frame %.1f ms: %llu iterations (%llu saved), %llu computed %llu filled pixels, "
+               "%llu escaped %llu interior\n",
+            stats.frame_ms, (unsigned long long)stats.iterations, (unsigned long long)stats.saved_iterations,
+            (unsigned long long)stats.computed_pixels, (unsigned long long)stats.filled_pixels,
+            (unsigned long long)stats.escaped_pixels, (unsigned long long)stats.interior_pixels);
+    }
+
+    // the next free slot of the pixel buffer, one 32 bit value per pixel
+    void* map_cpu_frame(ivec2 size)
+    {
+        size_t frame_size = size_t(size.x) * size_t(size.y) * sizeof(int);
+
+        if (iterations_buffer->slot_size() != frame_size) {
+            iterations_buffer->allocate(frame_size, PIXEL_BUFFER_SLOTS);
+        }
+
+        return iterations_buffer->map_slot();
+    }
+
+    void upload_cpu_frame(ivec2 size)
+    {
+        if (iterations_texture->size() != size) {
+            iterations_texture->allocate(size, GL_R32I, GL_RED_INTEGER, GL_INT);
+        }
+
+        iterations_texture->set_data(*iterations_buffer);
+        iterations_buffer->fence_slot();
+    }
+
+    // Progressive: every round of orbits is shown, the histogram keeps growing until a newer frame comes in.
+    // Frames of the same view (e.g. another palette) continue where the last one stopped.
+    void render_buddhabrot(const Frame& frame, Shader& shader)
+    {
+        const View& view = frame.view;
+
+        if (!buddhabrot_renderer || !buddhabrot_renderer->matches(view)) {
+            buddhabrot_renderer = std::make_unique<Buddhabrot>(view, buddhabrot_settings);
+
+            const std::string& checkpoint = buddhabrot_settings.checkpoint_path;
+            if (!checkpoint.empty() && buddhabrot_renderer->load_checkpoint(checkpoint)) {
+                printf("buddhabrot: resumed %s\n", checkpoint.c_str());
+            }
+        }
+
+        auto cancelled = [this]() { return renderer.cancelled(); };
+        bool presented = false;
+
+        while (buddhabrot_renderer->stats().orbits < BUDDHABROT_MAX_ORBITS) {
+            if (!buddhabrot_renderer->run(BUDDHABROT_ROUND_ORBITS, cancelled)) {
+                return;
+            }
+
+            buddhabrot_renderer->density(static_cast<float*>(map_cpu_frame(view.size)));
+            upload_cpu_frame(view.size);
+
+            iterations_texture->bind(0);
+            shader.set_uniform("u_iterations", 0);
+
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            if (!draw_strips(view.size) || renderer.cancelled()) {
+                return;
+            }
+
+            glfwSwapBuffers(m_window);
+
+            if (!presented) {
+                frame_presented(frame.input_serial);
+                presented = true;
+            }
+
+            if (frame.print_schedule) {
+                const BuddhabrotStats& stats = buddhabrot_renderer->stats();
+                printf("buddhabrot: %llu orbits (%llu drawn), %.2f M orbits/s on %d threads\n",
+                    (unsigned long long)stats.orbits, (unsigned long long)stats.drawn, stats.orbits_per_second() / 1e6,
+                    stats.threads);
+            }
+        }
+    }
+
+    // Renders the exponential map of the whole zoom once, then resamples and presents its frames in a loop
+    // until a newer frame comes in.
+    void render_zoom_video(const Frame& frame, Shader& shader)
+    {
+        const View& view = frame.view;
+        auto cancelled = [this]() { return renderer.cancelled(); };
+        auto start = std::chrono::steady_clock::now();
+
+        ExpMap exp_map(view, frame.zoom_path);
+
+        if (!exp_map.render(cancelled)) {
+            return;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double direct_pixels = double(view.size.x) * double(view.size.y) * frame.zoom_path.frames;
+        double map_pixels = double(exp_map.strip_samples()) + double(exp_map.patch_pixels()) * frame.zoom_path.frames;
+
+        printf("zoom video: %dx%d strip in %.2f s, %.1fx fewer pixels than rendering every frame\n",
+            exp_map.strip_size().x, exp_map.strip_size().y, seconds, direct_pixels / map_pixels);
+
+        auto frame_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / ZOOM_VIDEO_FPS));
+        auto next_swap = std::chrono::steady_clock::now();
+        bool presented = false;
+
+        for (int i = 0;; i = (i + 1) % frame.zoom_path.frames) {
+            if (!exp_map.render_frame(i, static_cast<int*>(map_cpu_frame(view.size)), cancelled)) {
+                return;
+            }
+
+            upload_cpu_frame(view.size);
+
+            iterations_texture->bind(0);
+            shader.set_uniform("u_iterations", 0);
+
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            if (!draw_strips(view.size) || renderer.cancelled()) {
+                return;
+            }
+
+            // a slow frame delays the rest of the video instead of making it skip
+            next_swap = std::max(next_swap + frame_interval, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(next_swap);
+
+            glfwSwapBuffers(m_window);
+
+            if (!presented) {
+                frame_presented(frame.input_serial);
+                presented = true;
+            }
+        }
+    }
+
+    void print_schedule_stats(const ScheduleStats& stats)
+    {
+        printf("frame %.1f ms: %zu tiles (%zu split, %s), %zu threads busy %.1f ms mean %.1f ms max, "
+               "imbalance %.2f, tail %.1f ms\n",
+            stats.frame_ms, stats.tiles, stats.split_tiles, stats.estimated ? "estimated" : "uniform", stats.threads,
+            stats.busy_mean_ms, stats.busy_max_ms, stats.imbalance(), stats.tail_ms);
+    }
+
+    Shader load_shader(std::string folder_path, const std::string& kernel)
     {
         ShaderBuilder builder;
         builder.add_shader(GL_VERTEX_SHADER, folder_path + "/vertex.glsl");
-        builder.add_shader(GL_FRAGMENT_SHADER, folder_path + "/fragment.glsl");
+        builder.add_shader(GL_FRAGMENT_SHADER, folder_path + "/fragment.glsl", kernel);
         builder.compile_and_link();
         return builder.finish();
     }
 
-    Shader* current_shader() { return shaders[shader_idx]; }
+    // shaders are generated per (coloring, formula, mode, precision) and compiled the first time they are needed
+    Shader& shader_for(const Frame& frame, Precision shader_precision)
+    {
+        const View& view = frame.view;
+
+        std::string folder_path = "res/shader" + std::to_string(frame.shader_idx + 1);
+        std::string key = folder_path + "/" + formula_name(view.formula) + (view.julia ? "/julia/" : "/")
+            + precision_name(shader_precision);
+
+        if (frame.buddhabrot) {
+            folder_path = "res/buddhabrot";
+            key = folder_path + "/cpu";
+        } else if (frame.heatmap) {
+            folder_path = "res/heatmap";
+            key = folder_path + "/cpu";
+        } else if (frame.distance_shading) {
+            folder_path = "res/distance";
+            key = folder_path + "/cpu";
+        } else if (frame.cpu_rendering) {
+            key = folder_path + "/cpu";
+        }
+
+        if (auto it = shaders.find(key); it != shaders.end()) {
+            return (*it).second;
+        }
+
+        if (!frame.cpu_rendering && shader_precision == view.precision) {
+            // compile the other precisions as well so the switch during a zoom does not stall
+            for (int i = 0; i <= int(gpu_precision.max_precision()); i++) {
+                if (Precision(i) != shader_precision) {
+                    shader_for(frame, Precision(i));
+                }
+            }
+        }
+
+        std::string kernel;
+
+        if (frame.buddhabrot) {
+            kernel = glsl_texture_density();
+        } else if (frame.heatmap) {
+            kernel = glsl_texture_cost();
+        } else if (frame.distance_shading) {
+            kernel = glsl_texture_distance();
+        } else if (frame.cpu_rendering) {
+            kernel = glsl_texture_kernel();
+        } else {
+            kernel = glsl_kernel(view.formula, view.julia, shader_precision);
+        }
+
+        return (*shaders.emplace(key, load_shader(folder_path, kernel)).first).second;
+    }
 
     dvec2 screen_to_world(dvec2 screen)
     {
@@ -173,26 +691,83 @@ public:
 private:
     dvec2 scale { 200.0, 200.0 };
     dvec2 offset { 0.0, 0.0 };
+    Complex<DeepReal> deep_offset { DeepReal(0), DeepReal(0) };
 
     dvec2 drag_pos { 0, 0 };
     bool dragging = false;
 
     int max_iterations = 1000;
 
-    Shader* shaders[NUM_SHADERS];
+    FormulaType formula = FormulaType::Mandelbrot;
+    bool julia = false;
+    dvec2 julia_c { 0.0, 0.0 };
+
     size_t shader_idx = 0;
 
-    int* m_iterations { nullptr };
+    bool cpu_rendering = false;
+    bool distance_shading = false;
+    bool buddhabrot = false;
+    bool heatmap = false;
+    bool print_schedule = false;
+
+    // set by the T key and cleared by the render thread once it wrote the stats of a complete cpu frame,
+    // superseded frames are dropped by the queue so the request can't travel with one
+    std::atomic<bool> dump_stats { false };
+
+    PrecisionDispatcher gpu_precision { Precision::Double };
+    PrecisionDispatcher cpu_precision { Precision::Deep };
+    Precision precision = Precision::Double;
+    bool precision_warning = false;
+
+    RenderThread<Frame> renderer;
+    Frame pending_frame;
+    bool frame_pending = false;
+
+    // owned by the render thread
+    std::unique_ptr<VertexBuffer> quad_buffer;
+    std::unique_ptr<VertexArray> quad_array;
+    std::unique_ptr<Texture> iterations_texture;
+    std::unique_ptr<PixelBuffer> iterations_buffer;
+    TileScheduler scheduler;
+    BuddhabrotSettings buddhabrot_settings;
+    std::unique_ptr<Buddhabrot> buddhabrot_renderer;
+    FrameStats frame_stats;
+    std::vector<float> distance_scratch;
+    std::vector<int> cost_scratch;
+    std::unordered_map<std::string, Shader> shaders;
 };
 
-int main()
+// mandelbrot [--record <log> | --replay <log> | --replay-fast <log>] [--buddhabrot-checkpoint <file>]
+int main(int argc, char** argv)
 {
     MyApp app;
 
-    if (app.init(1280, 960)) {
-        app.run();
-        return 0;
+    if (!app.init(1280, 960)) {
+        return -1;
+    }
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        bool ok = true;
+
+        if (option == "--record") {
+            ok = app.record_input(argv[i + 1]);
+        } else if (option == "--replay") {
+            ok = app.replay_input(argv[i + 1], true);
+        } else if (option == "--replay-fast") {
+            ok = app.replay_input(argv[i + 1], false);
+        } else if (option == "--buddhabrot-checkpoint") {
+            app.set_buddhabrot_checkpoint(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            ok = false;
+        }
+
+        if (!ok) {
+            return -1;
+        }
     }
 
-    return -1;
+    app.run();
+    return 0;
 }
\ No newline at end of file